@@ -0,0 +1,430 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Export the metadata for all the objects in a bucket to compressed files that
+// can be bulk loaded into the `gcs_objects` table.
+//
+// Usage: bulk_export_gcs <bucket> <output-directory> [threads] [import-uri]
+//
+// Indexing a bucket with billions of objects one commit at a time is slow and
+// expensive. This program lists the bucket in parallel, each thread writes its
+// rows to a sequence of gzip-compressed CSV files, plus a `manifest.json` file
+// for the "Text Files to Cloud Spanner" Dataflow template. Copy the files to
+// `import-uri` (a `gs://` path, by default the output directory) and run the
+// template to load them, with a backslash as the `escape` character and
+// `trailingDelimiter=false`. The output directory must exist.
+//
+// A file contains several sorted ranges of object names, `shards.json` lists
+// them.
+
+#include "gcs_indexing.h"
+#include "split_policy.h"
+#include <absl/time/time.h>
+#include <google/cloud/spanner/timestamp.h>
+#include <google/cloud/storage/client.h>
+#include <nlohmann/json.hpp>
+#include <zlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+namespace gcs = ::google::cloud::storage;
+namespace spanner = ::google::cloud::spanner;
+using google::cloud::cpp_samples::ColumnType;
+using google::cloud::cpp_samples::kObjectColumnCount;
+using google::cloud::cpp_samples::kObjectColumns;
+using google::cloud::cpp_samples::ObjectColumn;
+using google::cloud::cpp_samples::ObjectColumnValue;
+using google::cloud::cpp_samples::SplitPolicy;
+
+// Start a new file after this many rows. Smaller files make the import more
+// parallel, but each file adds some overhead.
+auto constexpr kRowsPerFile = 1'000'000;
+
+struct Counters {
+  std::atomic<std::int64_t> objects{0};
+  std::atomic<std::int64_t> prefixes{0};
+  std::atomic<std::int64_t> splits{0};
+  std::atomic<std::int64_t> raw_bytes{0};
+  std::atomic<std::int64_t> files{0};
+};
+
+/// A range of names to list, within a prefix.
+struct WorkItem {
+  std::string prefix;
+  std::string start;
+  std::string end;
+};
+
+/// A thread-safe queue of work items, it is done once it is empty and no
+/// worker is processing an item.
+class WorkQueue {
+ public:
+  void Push(WorkItem item) {
+    std::lock_guard<std::mutex> lk(mu_);
+    items_.push_back(std::move(item));
+    cv_.notify_one();
+  }
+
+  bool Pop(WorkItem& item) {
+    std::unique_lock<std::mutex> lk(mu_);
+    cv_.wait(lk, [this] { return !items_.empty() || active_ == 0; });
+    if (items_.empty()) return false;
+    item = std::move(items_.front());
+    items_.pop_front();
+    ++active_;
+    return true;
+  }
+
+  void Done() {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (--active_ == 0 && items_.empty()) cv_.notify_all();
+  }
+
+ private:
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::deque<WorkItem> items_;
+  std::size_t active_ = 0;
+};
+
+/// An output file, and the ranges of names it contains. Each range is sorted.
+struct Shard {
+  struct Range {
+    std::string first;
+    std::string last;
+  };
+  std::string filename;
+  std::vector<Range> ranges;
+  std::int64_t rows = 0;
+};
+
+void AppendEscaped(std::string& out, std::string const& s) {
+  out.push_back('"');
+  for (auto c : s) {
+    if (c == '"' || c == '\\') out.push_back('\\');
+    out.push_back(c);
+  }
+  out.push_back('"');
+}
+
+/// Append the value of @p column as a CSV field, null values are empty.
+void AppendField(std::string& out, gcs::ObjectMetadata const& o,
+                 ObjectColumn column) {
+  auto const v = ObjectColumnValue(o, column);
+  switch (kObjectColumns[static_cast<std::size_t>(column)].type) {
+    case ColumnType::kString:
+    case ColumnType::kJson:
+      if (auto s = v.get<absl::optional<std::string>>().value()) {
+        AppendEscaped(out, *s);
+      }
+      return;
+    case ColumnType::kInt64:
+      if (auto i = v.get<absl::optional<std::int64_t>>().value()) {
+        out += std::to_string(*i);
+      }
+      return;
+    case ColumnType::kBool:
+      if (auto b = v.get<absl::optional<bool>>().value()) {
+        out += *b ? "true" : "false";
+      }
+      return;
+    case ColumnType::kTimestamp:
+      if (auto ts = v.get<absl::optional<spanner::Timestamp>>().value()) {
+        out += absl::FormatTime(absl::RFC3339_full,
+                                ts->get<absl::Time>().value(),
+                                absl::UTCTimeZone());
+      }
+      return;
+  }
+}
+
+/// Writes rows to a sequence of gzip-compressed files. Each listing produces a
+/// sorted range of names, the writer records these ranges for each file.
+class ShardWriter {
+ public:
+  ShardWriter(std::string directory, std::atomic<int>& sequence,
+              Counters& counters)
+      : directory_(std::move(directory)),
+        sequence_(sequence),
+        counters_(counters) {}
+  // Errors are reported by `Close()`, this only releases the file if the
+  // export failed before closing it.
+  ~ShardWriter() {
+    if (file_ != nullptr) gzclose(file_);
+  }
+
+  /// The following rows start a new range of names.
+  void StartRange() { new_range_ = true; }
+
+  void Write(gcs::ObjectMetadata const& o) {
+    if (file_ == nullptr) Open();
+    if (new_range_) current_.ranges.push_back({o.name(), o.name()});
+    new_range_ = false;
+    line_.clear();
+    for (std::size_t i = 0; i != kObjectColumnCount; ++i) {
+      if (i != 0) line_.push_back(',');
+      AppendField(line_, o, static_cast<ObjectColumn>(i));
+    }
+    line_.push_back('\n');
+    if (gzwrite(file_, line_.data(), static_cast<unsigned>(line_.size())) ==
+        0) {
+      throw std::runtime_error("error writing " + current_.filename);
+    }
+    counters_.raw_bytes += static_cast<std::int64_t>(line_.size());
+    current_.ranges.back().last = o.name();
+    if (++current_.rows == kRowsPerFile) Close();
+  }
+
+  void Close() {
+    if (file_ == nullptr) return;
+    if (gzclose(file_) != Z_OK) {
+      throw std::runtime_error("error closing " + current_.filename);
+    }
+    file_ = nullptr;
+    shards_.push_back(std::move(current_));
+    current_ = Shard{};
+    new_range_ = true;
+  }
+
+  std::vector<Shard> const& shards() const { return shards_; }
+
+ private:
+  void Open() {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "gcs_objects-%06d.csv.gz", ++sequence_);
+    current_ = Shard{buf, {}, 0};
+    auto const path = directory_ + "/" + current_.filename;
+    file_ = gzopen(path.c_str(), "wb6");
+    if (file_ == nullptr) throw std::runtime_error("cannot create " + path);
+    ++counters_.files;
+  }
+
+  std::string directory_;
+  std::atomic<int>& sequence_;
+  Counters& counters_;
+  gzFile file_ = nullptr;
+  Shard current_;
+  bool new_range_ = true;
+  std::string line_;
+  std::vector<Shard> shards_;
+};
+
+void ListRange(gcs::Client& client, std::string const& bucket,
+               WorkItem const& item, WorkQueue& queue, ShardWriter& writer,
+               Counters& counters) {
+  // There is no deadline for an offline export, but large ranges are still
+  // split so other threads can help.
+  auto const deadline =
+      SplitPolicy::Clock::now() + std::chrono::hours(24 * 365);
+  SplitPolicy policy(item.prefix, item.start, item.end, deadline);
+  writer.StartRange();
+  auto const start_offset =
+      item.start.empty() ? gcs::StartOffset() : gcs::StartOffset(item.start);
+  auto const end_offset =
+      item.end.empty() ? gcs::EndOffset() : gcs::EndOffset(item.end);
+  auto const prefix =
+      item.prefix.empty() ? gcs::Prefix() : gcs::Prefix(item.prefix);
+  for (auto& entry : client.ListObjectsAndPrefixes(
+           bucket, prefix, start_offset, end_offset, gcs::Delimiter("/"))) {
+    if (!entry) {
+      throw std::runtime_error("error listing " + bucket + "/" + item.prefix +
+                               ": " + entry.status().message());
+    }
+    struct EntryName {
+      std::string const& operator()(std::string const& s) { return s; }
+      std::string const& operator()(gcs::ObjectMetadata const& o) {
+        return o.name();
+      }
+    };
+    auto const& name = absl::visit(EntryName{}, *entry);
+    if (policy.Done(name)) break;
+    auto decision = policy.OnEntry(name);
+    for (auto& range : decision.handoff) {
+      queue.Push(WorkItem{item.prefix, std::move(range.start),
+                          std::move(range.end)});
+      ++counters.splits;
+    }
+    if (auto const* p = absl::get_if<std::string>(&*entry)) {
+      if (*p != item.prefix) queue.Push(WorkItem{*p, {}, {}});
+      ++counters.prefixes;
+      continue;
+    }
+    writer.Write(absl::get<gcs::ObjectMetadata>(*entry));
+    ++counters.objects;
+  }
+}
+
+std::string SpannerType(ColumnType type) {
+  switch (type) {
+    case ColumnType::kInt64:
+      return "INT64";
+    case ColumnType::kBool:
+      return "BOOL";
+    case ColumnType::kTimestamp:
+      return "TIMESTAMP";
+    case ColumnType::kJson:
+      return "JSON";
+    case ColumnType::kString:
+      break;
+  }
+  return "STRING";
+}
+
+void WriteJson(std::string const& path, nlohmann::json const& json) {
+  std::ofstream os(path);
+  os << json.dump(2) << "\n";
+  os.close();
+  if (!os) throw std::runtime_error("error writing " + path);
+}
+
+void WriteManifests(std::string const& directory, std::string const& uri,
+                    std::vector<Shard> const& shards) {
+  auto columns = nlohmann::json::array();
+  for (auto const& c : kObjectColumns) {
+    columns.push_back(nlohmann::json{{"column_name", std::string(c.name)},
+                                     {"type_name", SpannerType(c.type)}});
+  }
+  auto files = nlohmann::json::array();
+  for (auto const& s : shards) files.push_back(uri + "/" + s.filename);
+  auto manifest = nlohmann::json{
+      {"tables", nlohmann::json::array({nlohmann::json{
+                     {"table_name", "gcs_objects"},
+                     {"file_patterns", std::move(files)},
+                     {"columns", std::move(columns)},
+                 }})},
+  };
+  WriteJson(directory + "/manifest.json", manifest);
+
+  auto ranges = nlohmann::json::array();
+  for (auto const& s : shards) {
+    auto r = nlohmann::json::array();
+    for (auto const& range : s.ranges) {
+      r.push_back(nlohmann::json::array({range.first, range.last}));
+    }
+    ranges.push_back(nlohmann::json{
+        {"file", s.filename}, {"rows", s.rows}, {"ranges", std::move(r)}});
+  }
+  WriteJson(directory + "/shards.json", ranges);
+}
+
+void Report(Counters const& counters,
+            std::chrono::steady_clock::time_point start,
+            std::int64_t& last_objects) {
+  using seconds = std::chrono::duration<double>;
+  auto const elapsed = std::chrono::duration_cast<seconds>(
+      std::chrono::steady_clock::now() - start);
+  auto const objects = counters.objects.load();
+  std::cout << "export: objects=" << objects
+            << ", prefixes=" << counters.prefixes.load()
+            << ", splits=" << counters.splits.load()
+            << ", files=" << counters.files.load()
+            << ", raw_bytes=" << counters.raw_bytes.load()
+            << ", objects/s=" << objects / elapsed.count()
+            << ", recent_objects=" << objects - last_objects << std::endl;
+  last_objects = objects;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) try {
+  if (argc < 3 || argc > 5) {
+    std::cerr << "Usage: " << argv[0]
+              << " <bucket> <output-directory> [threads] [import-uri]\n";
+    return 1;
+  }
+  std::string const bucket = argv[1];
+  std::string const directory = argv[2];
+  auto const threads =
+      argc > 3 ? std::stoi(argv[3])
+               : static_cast<int>((std::max)(
+                     16U, 4 * std::thread::hardware_concurrency()));
+  std::string const uri = argc > 4 ? argv[4] : directory;
+
+  Counters counters;
+  WorkQueue queue;
+  queue.Push(WorkItem{});
+  std::atomic<int> sequence{0};
+  std::mutex mu;
+  std::vector<Shard> shards;
+  std::exception_ptr error;
+
+  auto const start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int i = 0; i != threads; ++i) {
+    workers.emplace_back([&] {
+      auto record_error = [&] {
+        std::lock_guard<std::mutex> lk(mu);
+        if (!error) error = std::current_exception();
+      };
+      auto client = gcs::Client();
+      ShardWriter writer(directory, sequence, counters);
+      WorkItem item;
+      while (queue.Pop(item)) {
+        try {
+          ListRange(client, bucket, item, queue, writer, counters);
+        } catch (...) {
+          record_error();
+        }
+        queue.Done();
+      }
+      try {
+        writer.Close();
+      } catch (...) {
+        return record_error();
+      }
+      std::lock_guard<std::mutex> lk(mu);
+      shards.insert(shards.end(), writer.shards().begin(),
+                    writer.shards().end());
+    });
+  }
+
+  std::promise<void> done;
+  auto reporter = std::thread([&counters, start, f = done.get_future()] {
+    std::int64_t last_objects = 0;
+    while (f.wait_for(std::chrono::seconds(10)) ==
+           std::future_status::timeout) {
+      Report(counters, start, last_objects);
+    }
+  });
+  for (auto& t : workers) t.join();
+  done.set_value();
+  reporter.join();
+  if (error) std::rethrow_exception(error);
+
+  std::sort(shards.begin(), shards.end(), [](auto const& a, auto const& b) {
+    return a.filename < b.filename;
+  });
+  WriteManifests(directory, uri, shards);
+  std::int64_t last_objects = 0;
+  Report(counters, start, last_objects);
+  return 0;
+} catch (std::exception const& ex) {
+  std::cerr << "Standard C++ exception thrown: " << ex.what() << "\n";
+  return 1;
+}
@@ -14,156 +14,141 @@
 
 #include "gcs_indexing.h"
 #include <nlohmann/json.hpp>
-#include <functional>
-#include <iostream>
-#include <map>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
 #include <string>
-#include <vector>
 
 namespace google::cloud::cpp_samples {
 
 namespace gcs = ::google::cloud::storage;
 namespace spanner = ::google::cloud::spanner;
 
-using GetField = std::function<spanner::Value(gcs::ObjectMetadata const&)>;
-
-auto const& Columns() {
-  static auto const columns = [] {
-    auto field = [](auto name, auto functor) {
-      return std::pair<std::string const, GetField>(
-          std::move(name),
-          [f = std::move(functor)](gcs::ObjectMetadata const& o) {
-            return spanner::Value(f(o));
-          });
-    };
-
-    auto custom = [](auto name, auto functor) {
-      return std::pair<std::string const, GetField>(
-          std::move(name), [f = std::move(functor)](
-                               gcs::ObjectMetadata const& o) { return f(o); });
-    };
-
-    auto optional_string = [](auto name, auto functor) {
-      return std::pair<std::string const, GetField>(
-          std::move(name),
-          [f = std::move(functor)](gcs::ObjectMetadata const& o) {
-            auto s = f(o);
-            if (s.empty()) return spanner::Value(absl::optional<std::string>());
-            return spanner::Value(std::move(s));
-          });
-    };
-
-    auto timestamp = [](auto name, auto functor) {
-      return std::pair<std::string const, GetField>(
-          std::move(name),
-          [f = std::move(functor)](gcs::ObjectMetadata const& o) {
-            auto tp = f(o);
-            if (tp == std::chrono::system_clock::time_point{}) {
-              return spanner::Value(absl::optional<spanner::Timestamp>());
-            }
-            auto ts = spanner::MakeTimestamp(tp).value();
-            return spanner::Value(ts);
-          });
-    };
-
-    return std::map<std::string, GetField>({
-        field("name", [](auto const& o) { return o.name(); }),
-        field("bucket", [](auto const& o) { return o.bucket(); }),
-        field("generation", [](auto const& o) { return o.generation(); }),
-        field("metageneration",
-              [](auto const& o) { return o.metageneration(); }),
-        timestamp("timeCreated",
-                  [](auto const& o) { return o.time_created(); }),
-        timestamp("updated", [](auto const& o) { return o.updated(); }),
-        timestamp("timeDeleted",
-                  [](auto const& o) { return o.time_deleted(); }),
-        timestamp("customTime", [](auto const& o) { return o.custom_time(); }),
-        field("temporaryHold",
-              [](auto const& o) { return o.temporary_hold(); }),
-        field("eventBasedHold",
-              [](auto const& o) { return o.event_based_hold(); }),
-        timestamp("retentionExpirationTime",
-                  [](auto const& o) { return o.retention_expiration_time(); }),
-        field("storageClass", [](auto const& o) { return o.storage_class(); }),
-        timestamp("timeStorageClassUpdated",
-                  [](auto const& o) { return o.time_storage_class_updated(); }),
-        field(
-            "size",
-            [](auto const& o) { return static_cast<std::int64_t>(o.size()); }),
-        field("crc32c", [](auto const& o) { return o.crc32c(); }),
-        optional_string("md5Hash", [](auto const& o) { return o.md5_hash(); }),
-        optional_string("contentType",
-                        [](auto const& o) { return o.content_type(); }),
-        optional_string("contentEncoding",
-                        [](auto const& o) { return o.content_encoding(); }),
-        optional_string("contentDisposition",
-                        [](auto const& o) { return o.content_disposition(); }),
-        optional_string("contentLanguage",
-                        [](auto const& o) { return o.content_language(); }),
-        optional_string("cacheControl",
-                        [](auto const& o) { return o.cache_control(); }),
-
-        field("metadata",
-              [](auto const& o) {
-                nlohmann::json json{};
-                for (auto const& [k, v] : o.metadata()) json[k] = v;
-                return json.dump();
-              }),
-        custom("owner",
-               [](auto const& o) {
-                 if (!o.has_owner()) {
-                   return spanner::Value(absl::optional<std::string>());
-                 }
-                 return spanner::Value(nlohmann::json{
-                     {"entity", o.owner().entity},
-                     {"entityId",
-                      o.owner().entity_id}}.dump());
-               }),
-        field("componentCount",
-              [](auto const& o) { return o.component_count(); }),
-        optional_string("etag", [](auto const& o) { return o.etag(); }),
-        custom("customerEncryption",
-               [](auto const& o) {
-                 if (!o.has_customer_encryption()) {
-                   return spanner::Value(absl::optional<std::string>());
-                 }
-                 return spanner::Value(nlohmann::json{
-                     {"encryptionAlgorithm",
-                      o.customer_encryption().encryption_algorithm},
-                     {"keySha256", o.customer_encryption().key_sha256}}
-                                           .dump());
-               }),
-        optional_string("kmsKeyName",
-                        [](auto const& o) { return o.kms_key_name(); }),
-    });
-  }();
-  return columns;
+namespace {
+
+void OptionalString(ColumnSink& sink, std::string const& s) {
+  if (s.empty()) return sink.Null();
+  sink.String(s);
 }
 
-auto Names() {
-  static auto const names = [] {
-    auto columns = Columns();
-    std::vector<std::string> names(columns.size());
-    std::transform(columns.begin(), columns.end(), names.begin(),
-                   [](auto p) { return p.first; });
-    return names;
-  }();
-  return names;
+void OptionalTimestamp(ColumnSink& sink,
+                       std::chrono::system_clock::time_point tp) {
+  if (tp == std::chrono::system_clock::time_point{}) return sink.Null();
+  sink.Timestamp(tp);
 }
 
-std::size_t ColumnCount() { return Columns().size(); }
+class ValueSink : public ColumnSink {
+ public:
+  explicit ValueSink(ColumnType type) : type_(type) {}
+
+  void Null() override { value_ = NullValue(type_); }
+  void String(std::string const& v) override { value_ = spanner::Value(v); }
+  void Int64(std::int64_t v) override { value_ = spanner::Value(v); }
+  void Bool(bool v) override { value_ = spanner::Value(v); }
+  void Timestamp(std::chrono::system_clock::time_point v) override {
+    value_ = spanner::Value(spanner::MakeTimestamp(v).value());
+  }
+
+  spanner::Value value() && { return std::move(value_); }
+
+ private:
+  ColumnType type_;
+  spanner::Value value_;
+};
+
+}  // namespace
+
+void WriteObjectColumn(gcs::ObjectMetadata const& o, ObjectColumn column,
+                       ColumnSink& sink) {
+  // Without a `default:` label the compiler warns about any column in the
+  // schema that is not handled here.
+  switch (column) {
+    case ObjectColumn::kBucket:
+      return sink.String(o.bucket());
+    case ObjectColumn::kCacheControl:
+      return OptionalString(sink, o.cache_control());
+    case ObjectColumn::kComponentCount:
+      return sink.Int64(o.component_count());
+    case ObjectColumn::kContentDisposition:
+      return OptionalString(sink, o.content_disposition());
+    case ObjectColumn::kContentEncoding:
+      return OptionalString(sink, o.content_encoding());
+    case ObjectColumn::kContentLanguage:
+      return OptionalString(sink, o.content_language());
+    case ObjectColumn::kContentType:
+      return OptionalString(sink, o.content_type());
+    case ObjectColumn::kCrc32c:
+      return sink.String(o.crc32c());
+    case ObjectColumn::kCustomTime:
+      return OptionalTimestamp(sink, o.custom_time());
+    case ObjectColumn::kCustomerEncryption:
+      if (!o.has_customer_encryption()) return sink.Null();
+      return sink.String(
+          nlohmann::json{
+              {"encryptionAlgorithm",
+               o.customer_encryption().encryption_algorithm},
+              {"keySha256", o.customer_encryption().key_sha256}}
+              .dump());
+    case ObjectColumn::kEtag:
+      return OptionalString(sink, o.etag());
+    case ObjectColumn::kEventBasedHold:
+      return sink.Bool(o.event_based_hold());
+    case ObjectColumn::kGeneration:
+      return sink.Int64(o.generation());
+    case ObjectColumn::kKmsKeyName:
+      return OptionalString(sink, o.kms_key_name());
+    case ObjectColumn::kMd5Hash:
+      return OptionalString(sink, o.md5_hash());
+    case ObjectColumn::kMetadata: {
+      nlohmann::json json{};
+      for (auto const& [k, v] : o.metadata()) json[k] = v;
+      return sink.String(json.dump());
+    }
+    case ObjectColumn::kMetageneration:
+      return sink.Int64(o.metageneration());
+    case ObjectColumn::kName:
+      return sink.String(o.name());
+    case ObjectColumn::kOwner:
+      if (!o.has_owner()) return sink.Null();
+      return sink.String(nlohmann::json{{"entity", o.owner().entity},
+                                        {"entityId", o.owner().entity_id}}
+                             .dump());
+    case ObjectColumn::kRetentionExpirationTime:
+      return OptionalTimestamp(sink, o.retention_expiration_time());
+    case ObjectColumn::kSize:
+      return sink.Int64(static_cast<std::int64_t>(o.size()));
+    case ObjectColumn::kStorageClass:
+      return sink.String(o.storage_class());
+    case ObjectColumn::kTemporaryHold:
+      return sink.Bool(o.temporary_hold());
+    case ObjectColumn::kTimeCreated:
+      return OptionalTimestamp(sink, o.time_created());
+    case ObjectColumn::kTimeDeleted:
+      return OptionalTimestamp(sink, o.time_deleted());
+    case ObjectColumn::kTimeStorageClassUpdated:
+      return OptionalTimestamp(sink, o.time_storage_class_updated());
+    case ObjectColumn::kUpdated:
+      return OptionalTimestamp(sink, o.updated());
+  }
+  sink.Null();
+}
+
+spanner::Value ObjectColumnValue(gcs::ObjectMetadata const& o,
+                                 ObjectColumn column) {
+  ValueSink sink(kObjectColumns[Index(column)].type);
+  WriteObjectColumn(o, column, sink);
+  return std::move(sink).value();
+}
+
+std::size_t ColumnCount() { return kObjectColumnCount; }
 
 spanner::Mutation UpdateObjectMetadata(gcs::ObjectMetadata const& object) {
-  auto const& columns = Columns();
-  std::vector<spanner::Value> values(columns.size());
-  std::transform(columns.begin(), columns.end(), values.begin(),
-                 [&object](auto const& p) {
-                   auto const& [name, to_value] = p;
-                   return to_value(object);
-                 });
-  return spanner::InsertOrUpdateMutationBuilder("gcs_objects", Names())
-      .AddRow(std::move(values))
-      .Build();
+  thread_local ObjectRow row;
+  for (std::size_t i = 0; i != kObjectColumnCount; ++i) {
+    auto const column = static_cast<ObjectColumn>(i);
+    row.Set(column, ObjectColumnValue(object, column));
+  }
+  return row.MakeUpsert();
 }
 
 std::string GetEnv(char const* var) {
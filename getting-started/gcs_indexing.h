@@ -15,18 +15,42 @@
 #ifndef CPP_SAMPLES_GETTING_STARTED_GCS_INDEXING_H
 #define CPP_SAMPLES_GETTING_STARTED_GCS_INDEXING_H
 
+#include "update/gcs_objects_schema.h"
 #include <google/cloud/spanner/mutations.h>
 #include <google/cloud/storage/object_metadata.h>
+#include <chrono>
+#include <cstdint>
 #include <string>
 #include <vector>
 
 namespace google::cloud::cpp_samples {
 
+/// The number of columns in each `gcs_objects` row.
 std::size_t ColumnCount();
 
+/// Convert @p object into a `gcs_objects` upsert, see `gcs_objects_schema.h`.
 google::cloud::spanner::Mutation UpdateObjectMetadata(
     google::cloud::storage::ObjectMetadata const& object);
 
+/// Receives the value of a single column, see `WriteObjectColumn()`.
+class ColumnSink {
+ public:
+  virtual ~ColumnSink() = default;
+  virtual void Null() = 0;
+  virtual void String(std::string const& v) = 0;
+  virtual void Int64(std::int64_t v) = 0;
+  virtual void Bool(bool v) = 0;
+  virtual void Timestamp(std::chrono::system_clock::time_point v) = 0;
+};
+
+/// Write the value of @p column for @p object into @p sink.
+void WriteObjectColumn(google::cloud::storage::ObjectMetadata const& object,
+                       ObjectColumn column, ColumnSink& sink);
+
+/// The value of @p column for @p object.
+google::cloud::spanner::Value ObjectColumnValue(
+    google::cloud::storage::ObjectMetadata const& object, ObjectColumn column);
+
 std::string GetEnv(char const* var);
 
 }  // namespace google::cloud::cpp_samples
@@ -15,7 +15,8 @@
 
 -- Contains metadata for GCS objects
 --
--- The field names are chosen to match the JSON API field names.
+-- The field names are chosen to match the JSON API field names. Keep this in
+-- sync with `kObjectColumns` in update/gcs_objects_schema.h.
 CREATE TABLE gcs_objects (
     name STRING(1024) NOT NULL,
     -- The actual limit is 222 characters, but 256 is easier to remember.
@@ -0,0 +1,221 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gke/batch_arena.h"
+#include "gcs_indexing.h"
+#include <google/cloud/spanner/timestamp.h>
+#include <algorithm>
+#include <cstring>
+
+namespace google::cloud::cpp_samples {
+namespace {
+
+namespace gcs = ::google::cloud::storage;
+
+// Columns with few distinct values, their values are interned.
+bool IsInterned(ObjectColumn column) {
+  switch (column) {
+    case ObjectColumn::kBucket:
+    case ObjectColumn::kCacheControl:
+    case ObjectColumn::kContentDisposition:
+    case ObjectColumn::kContentEncoding:
+    case ObjectColumn::kContentLanguage:
+    case ObjectColumn::kContentType:
+    case ObjectColumn::kKmsKeyName:
+    case ObjectColumn::kStorageClass:
+      return true;
+    default:
+      return false;
+  }
+}
+
+class CellSink : public ColumnSink {
+ public:
+  CellSink(BatchArena& arena, Cell& cell, bool intern)
+      : arena_(arena), cell_(cell), intern_(intern) {}
+
+  void Null() override { cell_ = Cell{}; }
+  void String(std::string const& v) override {
+    cell_.kind = Cell::Kind::kString;
+    cell_.string = intern_ ? arena_.Intern(v) : arena_.Copy(v);
+  }
+  void Int64(std::int64_t v) override { Number(Cell::Kind::kInt64, v); }
+  void Bool(bool v) override { Number(Cell::Kind::kBool, v ? 1 : 0); }
+  void Timestamp(std::chrono::system_clock::time_point v) override {
+    using std::chrono::nanoseconds;
+    Number(Cell::Kind::kTimestamp,
+           std::chrono::duration_cast<nanoseconds>(v.time_since_epoch())
+               .count());
+  }
+
+ private:
+  void Number(Cell::Kind kind, std::int64_t v) {
+    cell_.kind = kind;
+    cell_.number = v;
+  }
+
+  BatchArena& arena_;
+  Cell& cell_;
+  bool intern_;
+};
+
+// The size of @p v encoded as a protobuf varint.
+std::size_t VarintSize(std::uint64_t v) {
+  std::size_t n = 1;
+  for (; v >= 0x80; v >>= 7) ++n;
+  return n;
+}
+
+// The size of a length-delimited field, with a single byte tag, containing
+// @p n bytes.
+std::size_t FieldSize(std::size_t n) { return 1 + VarintSize(n) + n; }
+
+std::size_t DecimalSize(std::int64_t v) {
+  auto u = v < 0 ? 0 - static_cast<std::uint64_t>(v)
+                 : static_cast<std::uint64_t>(v);
+  std::size_t n = v < 0 ? 2 : 1;
+  for (; u >= 10; u /= 10) ++n;
+  return n;
+}
+
+// The size of @p cell as a serialized `google.protobuf.Value`. Spanner
+// encodes INT64 and TIMESTAMP values as strings.
+std::size_t ValueSize(Cell const& cell) {
+  // `YYYY-MM-DDTHH:MM:SS.nnnnnnnnnZ`, shorter if the fraction is zero.
+  auto constexpr kMaxTimestampSize = std::size_t{30};
+  switch (cell.kind) {
+    case Cell::Kind::kNull:
+    case Cell::Kind::kBool:
+      // A one byte tag and a one byte varint.
+      return 2;
+    case Cell::Kind::kString:
+      return FieldSize(cell.string.size());
+    case Cell::Kind::kInt64:
+      return FieldSize(DecimalSize(cell.number));
+    case Cell::Kind::kTimestamp:
+      return FieldSize(kMaxTimestampSize);
+  }
+  return 0;
+}
+
+spanner::Value ToValue(Cell const& cell, ColumnType type) {
+  switch (cell.kind) {
+    case Cell::Kind::kNull:
+      break;
+    case Cell::Kind::kString:
+      return spanner::Value(std::string(cell.string));
+    case Cell::Kind::kInt64:
+      return spanner::Value(cell.number);
+    case Cell::Kind::kBool:
+      return spanner::Value(cell.number != 0);
+    case Cell::Kind::kTimestamp: {
+      using std::chrono::nanoseconds;
+      auto const tp =
+          std::chrono::time_point<std::chrono::system_clock, nanoseconds>(
+              nanoseconds(cell.number));
+      return spanner::Value(spanner::MakeTimestamp(tp).value());
+    }
+  }
+  return NullValue(type);
+}
+
+}  // namespace
+
+std::string_view BatchArena::Copy(std::string_view s) {
+  if (s.empty()) return {};
+  if (s.size() > available_) {
+    // Large strings get their own block, so they do not waste the remainder
+    // of the current block.
+    auto const size = (std::max)(kBlockSize, s.size());
+    blocks_.push_back(std::make_unique<char[]>(size));
+    allocated_ += size;
+    if (size != kBlockSize) {
+      std::memcpy(blocks_.back().get(), s.data(), s.size());
+      return {blocks_.back().get(), s.size()};
+    }
+    block_ = next_ = blocks_.back().get();
+    available_ = size;
+  }
+  std::memcpy(next_, s.data(), s.size());
+  std::string_view copy(next_, s.size());
+  next_ += s.size();
+  available_ -= s.size();
+  return copy;
+}
+
+std::string_view BatchArena::Intern(std::string_view s) {
+  auto i = interned_.find(s);
+  if (i != interned_.end()) return *i;
+  return *interned_.insert(Copy(s)).first;
+}
+
+void BatchArena::Reset() {
+  interned_.clear();
+  auto i = std::find_if(blocks_.begin(), blocks_.end(),
+                        [this](auto const& b) { return b.get() == block_; });
+  if (i == blocks_.end()) {
+    blocks_.clear();
+    block_ = next_ = nullptr;
+    available_ = allocated_ = 0;
+    return;
+  }
+  auto block = std::move(*i);
+  blocks_.clear();
+  blocks_.push_back(std::move(block));
+  next_ = block_;
+  available_ = allocated_ = kBlockSize;
+}
+
+std::size_t MakeArenaRow(gcs::ObjectMetadata const& object, BatchArena& arena,
+                         ArenaRow& row) {
+  for (std::size_t i = 0; i != kObjectColumnCount; ++i) {
+    auto const column = static_cast<ObjectColumn>(i);
+    CellSink sink(arena, row[i], IsInterned(column));
+    WriteObjectColumn(object, column, sink);
+  }
+  return EncodedSize(row);
+}
+
+void CopyArenaRow(ArenaRow const& source, BatchArena& arena, ArenaRow& row) {
+  for (std::size_t i = 0; i != kObjectColumnCount; ++i) {
+    row[i] = source[i];
+    if (source[i].kind != Cell::Kind::kString) continue;
+    row[i].string = IsInterned(static_cast<ObjectColumn>(i))
+                        ? arena.Intern(source[i].string)
+                        : arena.Copy(source[i].string);
+  }
+}
+
+std::size_t EncodedSize(ArenaRow const& row) {
+  // Each row is a `google.protobuf.ListValue` in a repeated field.
+  std::size_t size = 0;
+  for (auto const& cell : row) size += FieldSize(ValueSize(cell));
+  return FieldSize(size);
+}
+
+spanner::Mutation MakeUpsert(std::vector<ArenaRow const*> const& rows) {
+  auto builder = spanner::InsertOrUpdateMutationBuilder("gcs_objects",
+                                                       ObjectColumnNames());
+  for (auto const* row : rows) {
+    std::vector<spanner::Value> values;
+    values.reserve(kObjectColumnCount);
+    for (std::size_t i = 0; i != kObjectColumnCount; ++i) {
+      values.push_back(ToValue((*row)[i], kObjectColumns[i].type));
+    }
+    builder.AddRow(std::move(values));
+  }
+  return std::move(builder).Build();
+}
+
+}  // namespace google::cloud::cpp_samples
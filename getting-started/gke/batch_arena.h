@@ -0,0 +1,105 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_GETTING_STARTED_GKE_BATCH_ARENA_H
+#define CPP_SAMPLES_GETTING_STARTED_GKE_BATCH_ARENA_H
+
+#include "update/gcs_objects_schema.h"
+#include <google/cloud/spanner/mutations.h>
+#include <google/cloud/storage/object_metadata.h>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace google::cloud::cpp_samples {
+
+/**
+ * Owns the strings for a batch of rows.
+ *
+ * Strings are copied into large blocks, and released all at once when the
+ * arena is destroyed. Values from low-cardinality columns, such as the bucket
+ * name or the storage class, are interned: each distinct value is stored only
+ * once per arena.
+ *
+ * The class is not thread-safe.
+ */
+class BatchArena {
+ public:
+  BatchArena() = default;
+  BatchArena(BatchArena const&) = delete;
+  BatchArena& operator=(BatchArena const&) = delete;
+
+  /// Copy @p s into the arena.
+  std::string_view Copy(std::string_view s);
+  /// Return the arena's copy of @p s, creating it if needed.
+  std::string_view Intern(std::string_view s);
+  /// Release all the strings, keeping the current block for reuse.
+  void Reset();
+
+  /// The total size of the blocks allocated by the arena.
+  std::size_t allocated_bytes() const { return allocated_; }
+
+ private:
+  static auto constexpr kBlockSize = std::size_t{64 * 1024};
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  // The start of the block used for small strings, large strings get their
+  // own blocks.
+  char* block_ = nullptr;
+  char* next_ = nullptr;
+  std::size_t available_ = 0;
+  std::size_t allocated_ = 0;
+  std::unordered_set<std::string_view> interned_;
+};
+
+/// The value of one column, any strings are owned by a `BatchArena`.
+struct Cell {
+  enum class Kind : std::uint8_t { kNull, kString, kInt64, kBool, kTimestamp };
+  Kind kind = Kind::kNull;
+  // The value for integer, boolean, and timestamp (nanoseconds since the
+  // epoch) cells.
+  std::int64_t number = 0;
+  std::string_view string;
+};
+
+using ArenaRow = std::array<Cell, kObjectColumnCount>;
+
+/// Convert @p object into @p row, copying any strings into @p arena. Returns
+/// the size of the row once encoded in a multi-row mutation, see
+/// `EncodedSize()`.
+std::size_t MakeArenaRow(storage::ObjectMetadata const& object,
+                         BatchArena& arena, ArenaRow& row);
+
+/// Copy @p source into @p row, with its strings copied into @p arena.
+void CopyArenaRow(ArenaRow const& source, BatchArena& arena, ArenaRow& row);
+
+/**
+ * The size of @p row in the `values` of a `google.spanner.v1.Mutation.Write`.
+ *
+ * This is the exact size of the serialized proto, except for timestamps,
+ * which are counted at their maximum length (nanosecond precision). The
+ * result is never smaller than the real size. It does not include the table
+ * and column names, which are sent once per mutation.
+ */
+std::size_t EncodedSize(ArenaRow const& row);
+
+/// Create a single `gcs_objects` upsert for all the @p rows.
+spanner::Mutation MakeUpsert(std::vector<ArenaRow const*> const& rows);
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_GETTING_STARTED_GKE_BATCH_ARENA_H
@@ -0,0 +1,125 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measure the memory used to hold pending rows in the indexer.
+//
+// Usage: batch_memory_benchmark <mutations|arena> [object-count]
+//
+// Each run holds `object-count` rows in memory, and reports the growth of
+// the resident set size (RSS) normalized to one million objects:
+//   - `mutations` holds one `spanner::Mutation` per row, as the indexer did
+//     before using `BatchArena`.
+//   - `arena` holds batches of 512 `ArenaRow`s, each batch with its own
+//     `BatchArena`, as `MutationBatcher` does now.
+// Run each mode in a separate process, as memory released to the allocator is
+// not always returned to the operating system.
+
+#include "gcs_indexing.h"
+#include "gke/batch_arena.h"
+#include "gke/mutation_batcher.h"
+#include <google/cloud/storage/internal/object_metadata_parser.h>
+#include <nlohmann/json.hpp>
+#include <unistd.h>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+namespace gcs = ::google::cloud::storage;
+namespace spanner = ::google::cloud::spanner;
+using google::cloud::cpp_samples::ArenaRow;
+using google::cloud::cpp_samples::BatchArena;
+using google::cloud::cpp_samples::kEfficientRowLimit;
+using google::cloud::cpp_samples::MakeArenaRow;
+using google::cloud::cpp_samples::UpdateObjectMetadata;
+
+std::size_t ResidentSetSize() {
+  std::size_t pages = 0;
+  std::size_t resident = 0;
+  std::ifstream("/proc/self/statm") >> pages >> resident;
+  return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+gcs::ObjectMetadata MakeObject(std::int64_t i) {
+  auto const json = nlohmann::json{
+      {"bucket", "benchmark-bucket-" + std::to_string(i % 4)},
+      {"name", std::to_string(i % 1000) + "/some/path/to/object-" +
+                   std::to_string(i) + ".txt"},
+      {"generation", std::to_string(1'000'000 + i)},
+      {"metageneration", "1"},
+      {"timeCreated", "2021-07-01T12:00:00.123Z"},
+      {"updated", "2021-07-01T12:00:00.123Z"},
+      {"storageClass", "STANDARD"},
+      {"size", std::to_string(i * 1024)},
+      {"crc32c", "AAAAAA=="},
+      {"md5Hash", "1B2M2Y8AsgTpgAmY7PhCfg=="},
+      {"contentType", "application/octet-stream"},
+      {"etag", "CAE="},
+      {"metadata", {{"source", "benchmark"}}},
+  };
+  return gcs::internal::ObjectMetadataParser::FromString(json.dump()).value();
+}
+
+struct ArenaBatch {
+  BatchArena arena;
+  std::deque<ArenaRow> rows;
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) try {
+  if (argc < 2 || argc > 3) {
+    std::cerr << "Usage: " << argv[0] << " <mutations|arena> [object-count]\n";
+    return 1;
+  }
+  std::string const mode = argv[1];
+  auto const count = argc > 2 ? std::stoll(argv[2]) : 1'000'000LL;
+  if (mode != "mutations" && mode != "arena") {
+    std::cerr << "Unknown mode " << mode << "\n";
+    return 1;
+  }
+
+  std::vector<spanner::Mutation> mutations;
+  std::vector<std::unique_ptr<ArenaBatch>> batches;
+  auto const before = ResidentSetSize();
+  for (std::int64_t i = 0; i != count; ++i) {
+    auto const object = MakeObject(i);
+    if (mode == "mutations") {
+      mutations.push_back(UpdateObjectMetadata(object));
+      continue;
+    }
+    if (batches.empty() || batches.back()->rows.size() == kEfficientRowLimit) {
+      batches.push_back(std::make_unique<ArenaBatch>());
+    }
+    auto& batch = *batches.back();
+    MakeArenaRow(object, batch.arena, batch.rows.emplace_back());
+  }
+  auto const after = ResidentSetSize();
+
+  auto const growth = static_cast<double>(after - before);
+  std::cout << "mode=" << mode << ", objects=" << count
+            << ", rss_before=" << before << ", rss_after=" << after
+            << ", bytes/object=" << growth / static_cast<double>(count)
+            << ", MiB/million objects="
+            << growth / static_cast<double>(count) * 1'000'000 / (1024 * 1024)
+            << std::endl;
+  return 0;
+} catch (std::exception const& ex) {
+  std::cerr << "Standard C++ exception thrown: " << ex.what() << "\n";
+  return 1;
+}
@@ -0,0 +1,166 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Compare the CPU time and heap allocations per indexed object used to track
+// the completion of a message's operations.
+//
+// Usage: completion_benchmark [objects-per-message] [messages]
+//
+// The `when_all` mode collects a `future<Status>` per object, and combines
+// them with a `when_all()` helper, as the indexer used to do. The `tracker`
+// mode uses a `CompletionTracker`. In both cases the operations are completed
+// by a separate thread, as the batcher would do after each commit.
+
+#include "gke/completion_tracker.h"
+#include <google/cloud/future.h>
+#include <google/cloud/status.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::atomic<std::int64_t> allocations{0};
+
+}  // namespace
+
+// Count all the heap allocations in the program.
+void* operator new(std::size_t size) {
+  ++allocations;
+  if (auto* p = std::malloc(size == 0 ? 1 : size)) return p;
+  throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+using google::cloud::future;
+using google::cloud::promise;
+using google::cloud::Status;
+using google::cloud::cpp_samples::CompletionTracker;
+
+// The implementation previously used by the indexer.
+template <typename T>
+future<std::vector<future<T>>> when_all(std::vector<future<T>> w) {
+  class Accumulator : public std::enable_shared_from_this<Accumulator> {
+   public:
+    Accumulator() : unsatisfied_(0) {}
+
+    future<std::vector<future<T>>> Start(std::vector<future<T>> all) {
+      auto self = this->shared_from_this();
+      unsatisfied_ = all.size();
+      accumulator_.resize(all.size());
+      std::size_t i = 0;
+      for (auto& f : all) {
+        cont_.push_back(f.then([index = i++, self](future<T> g) {
+          self->OnCompletion(index, std::move(g));
+        }));
+      }
+      return done_.get_future();
+    }
+
+   private:
+    void OnCompletion(std::size_t index, future<T> g) {
+      accumulator_[index] = std::move(g);
+      if (--unsatisfied_ == 0) done_.set_value(std::move(accumulator_));
+    }
+    std::atomic<std::size_t> unsatisfied_;
+    std::vector<future<T>> accumulator_;
+    std::vector<future<void>> cont_;
+    promise<std::vector<future<T>>> done_;
+  };
+
+  auto accumulator = std::make_shared<Accumulator>();
+  return accumulator->Start(std::move(w));
+}
+
+// Simulate a single message with @p objects rows, returns once the message
+// would be acked.
+void RunMessageWhenAll(std::size_t objects) {
+  std::vector<promise<Status>> commits(objects);
+  std::vector<future<Status>> pending;
+  for (auto& p : commits) pending.push_back(p.get_future());
+  std::promise<void> acked;
+  when_all(std::move(pending)).then([&acked](auto f) {
+    auto v = f.get();
+    bool success = true;
+    for (auto& g : v) success = success && g.get().ok();
+    if (!success) std::cerr << "unexpected error\n";
+    acked.set_value();
+  });
+  std::thread([&commits] {
+    for (auto& p : commits) p.set_value(Status{});
+  }).join();
+  acked.get_future().get();
+}
+
+void RunMessageTracker(std::size_t objects) {
+  std::promise<void> acked;
+  auto tracker =
+      CompletionTracker::Create([&acked](Status) { acked.set_value(); });
+  std::vector<std::shared_ptr<CompletionTracker>> commits;
+  commits.reserve(objects);
+  for (std::size_t i = 0; i != objects; ++i) {
+    tracker->Add();
+    commits.push_back(tracker);
+  }
+  tracker->Done(Status{});
+  std::thread([&commits] {
+    for (auto& t : commits) t->Done(Status{});
+  }).join();
+  acked.get_future().get();
+}
+
+void Run(std::string const& label, std::size_t objects, long messages,
+         std::function<void(std::size_t)> const& run_message) {
+  auto const cpu_start = std::clock();
+  auto const start = std::chrono::steady_clock::now();
+  auto const allocations_start = allocations.load();
+  for (long i = 0; i != messages; ++i) run_message(objects);
+  auto const total_allocations = allocations.load() - allocations_start;
+  using seconds = std::chrono::duration<double>;
+  auto const elapsed = std::chrono::duration_cast<seconds>(
+      std::chrono::steady_clock::now() - start);
+  auto const cpu = static_cast<double>(std::clock() - cpu_start) /
+                   CLOCKS_PER_SEC;
+  auto const indexed = static_cast<double>(objects) * messages;
+  std::cout << label << ": objects=" << indexed
+            << ", elapsed=" << elapsed.count() << "s"
+            << ", cpu_ns/object=" << cpu * 1e9 / indexed
+            << ", allocations/object="
+            << static_cast<double>(total_allocations) / indexed << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) try {
+  auto const objects = argc > 1 ? std::stoul(argv[1]) : 1'000UL;
+  auto const messages = argc > 2 ? std::stol(argv[2]) : 1'000L;
+
+  Run("when_all", objects, messages, RunMessageWhenAll);
+  Run("tracker", objects, messages, RunMessageTracker);
+  return 0;
+} catch (std::exception const& ex) {
+  std::cerr << "Standard C++ exception thrown: " << ex.what() << "\n";
+  return 1;
+}
@@ -0,0 +1,90 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_GETTING_STARTED_GKE_COMPLETION_TRACKER_H
+#define CPP_SAMPLES_GETTING_STARTED_GKE_COMPLETION_TRACKER_H
+
+#include <google/cloud/future.h>
+#include <google/cloud/status.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace google::cloud::cpp_samples {
+
+/**
+ * Tracks the asynchronous operations started on behalf of a single message.
+ *
+ * Collecting a `future<Status>` per operation, and attaching a continuation
+ * to each, requires several heap allocations per indexed object. The tracker
+ * replaces them with an atomic counter and a slot for the first error. The
+ * producers call `Add()` before starting each operation, and the operation
+ * calls `Done()` when it completes. The tracker starts with one pending
+ * operation, representing the caller that creates it, which must also call
+ * `Done()` once it has started all the operations.
+ *
+ * The callback runs exactly once, in the thread that completes the last
+ * operation, with the first error reported (or an OK status).
+ */
+class CompletionTracker
+    : public std::enable_shared_from_this<CompletionTracker> {
+ public:
+  using Callback = std::function<void(Status)>;
+
+  static std::shared_ptr<CompletionTracker> Create(Callback on_done) {
+    return std::make_shared<CompletionTracker>(std::move(on_done));
+  }
+
+  explicit CompletionTracker(Callback on_done)
+      : on_done_(std::move(on_done)) {}
+
+  void Add(std::int64_t n = 1) {
+    pending_.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  void Done(Status const& status) {
+    if (!status.ok()) {
+      failures_.fetch_add(1, std::memory_order_relaxed);
+      if (!has_error_.exchange(true, std::memory_order_relaxed)) {
+        first_error_ = status;
+      }
+    }
+    // The release / acquire ordering makes `first_error_` visible to the
+    // thread running the callback.
+    if (pending_.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    auto on_done = std::move(on_done_);
+    on_done(has_error_.load() ? std::move(first_error_) : Status{});
+  }
+
+  /// Track an operation represented by a future.
+  void Track(future<Status> f) {
+    Add();
+    f.then([self = shared_from_this()](auto g) { self->Done(g.get()); });
+  }
+
+  /// The number of operations that failed so far.
+  std::int64_t failures() const { return failures_.load(); }
+
+ private:
+  std::atomic<std::int64_t> pending_{1};
+  std::atomic<std::int64_t> failures_{0};
+  std::atomic<bool> has_error_{false};
+  Status first_error_;
+  Callback on_done_;
+};
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_GETTING_STARTED_GKE_COMPLETION_TRACKER_H
@@ -0,0 +1,83 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gke/flow_controller.h"
+#include <algorithm>
+
+namespace google::cloud::cpp_samples {
+
+FlowController::FlowController(std::function<FlowSignals()> sample,
+                               FlowControllerOptions options)
+    : sample_(std::move(sample)),
+      options_(std::move(options)),
+      limit_((std::max)(options_.min_messages, std::size_t{1})),
+      next_adjust_(std::chrono::steady_clock::now()) {}
+
+FlowController::Admission FlowController::Admit() {
+  std::unique_lock lk(mu_);
+  AdjustIfNeeded(lk);
+  if (active_ >= limit_) {
+    auto const start = std::chrono::steady_clock::now();
+    // Wake up periodically, the limit may grow even if no messages complete.
+    while (active_ >= limit_) {
+      cv_.wait_for(lk, options_.adjust_interval);
+      AdjustIfNeeded(lk);
+    }
+    metrics_.throttled +=
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start);
+  }
+  ++active_;
+  return Admission(nullptr,
+                   [self = shared_from_this()](void*) { self->Release(); });
+}
+
+void FlowController::Release() {
+  std::unique_lock lk(mu_);
+  --active_;
+  AdjustIfNeeded(lk);
+  cv_.notify_one();
+}
+
+FlowController::Metrics FlowController::ResetMetrics() {
+  std::unique_lock lk(mu_);
+  auto m = metrics_;
+  m.limit = limit_;
+  m.active = active_;
+  metrics_ = Metrics{};
+  return m;
+}
+
+void FlowController::AdjustIfNeeded(std::unique_lock<std::mutex> const&) {
+  auto const now = std::chrono::steady_clock::now();
+  if (now < next_adjust_) return;
+  next_adjust_ = now + options_.adjust_interval;
+
+  auto const signals = sample_();
+  auto const min = (std::max)(options_.min_messages, std::size_t{1});
+  if (signals.commit_latency > options_.target_commit_latency ||
+      signals.pending_rows > options_.max_pending_rows) {
+    auto const limit = (std::max)(min, limit_ / 2);
+    if (limit != limit_) ++metrics_.decreases;
+    limit_ = limit;
+    return;
+  }
+  // Only grow the limit if it is actually constraining the work.
+  if (active_ < limit_) return;
+  limit_ =
+      (std::min)(options_.max_messages, limit_ + options_.message_increment);
+  cv_.notify_all();
+}
+
+}  // namespace google::cloud::cpp_samples
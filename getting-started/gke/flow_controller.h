@@ -0,0 +1,100 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_GETTING_STARTED_GKE_FLOW_CONTROLLER_H
+#define CPP_SAMPLES_GETTING_STARTED_GKE_FLOW_CONTROLLER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace google::cloud::cpp_samples {
+
+/// The signals used by `FlowController` to detect an overloaded backend.
+struct FlowSignals {
+  // Rows accepted by the batcher, but not yet committed.
+  std::size_t pending_rows = 0;
+  // A recent estimate of the commit latency.
+  std::chrono::milliseconds commit_latency{0};
+};
+
+/// Controls how `FlowController` adapts the number of messages in progress.
+struct FlowControllerOptions {
+  std::size_t min_messages = 4;
+  std::size_t max_messages = 128;
+  std::size_t message_increment = 1;
+  // Halve the limit if the commit latency exceeds this value, or if the
+  // pending rows exceed `max_pending_rows`.
+  std::chrono::milliseconds target_commit_latency = std::chrono::seconds(2);
+  std::size_t max_pending_rows = 8 * 1024;
+  // Sample the signals (and maybe change the limit) at most this often.
+  std::chrono::milliseconds adjust_interval = std::chrono::milliseconds(200);
+};
+
+/**
+ * Limits the number of Pub/Sub messages processed concurrently.
+ *
+ * The subscriber flow control settings are fixed when the subscription
+ * session starts, but the rate Spanner can sustain changes over time. Each
+ * message must be admitted by the controller before it is processed, and the
+ * returned token kept until all its work is done. Blocking in the subscriber
+ * callback keeps the message outstanding, so the service stops delivering
+ * more once the subscriber limits are reached.
+ *
+ * The limit follows an AIMD (additive increase, multiplicative decrease)
+ * policy: it grows by `message_increment` each interval where the backend is
+ * healthy and all the admitted messages are in use, and it is halved when the
+ * commit latency or the number of pending rows exceed their targets.
+ */
+class FlowController : public std::enable_shared_from_this<FlowController> {
+ public:
+  explicit FlowController(std::function<FlowSignals()> sample,
+                          FlowControllerOptions options = {});
+
+  /// Releases the admitted message when the last copy is destroyed.
+  using Admission = std::shared_ptr<void>;
+
+  /// Block until a new message can be processed.
+  Admission Admit();
+
+  struct Metrics {
+    std::size_t limit = 0;
+    std::size_t active = 0;
+    std::int64_t decreases = 0;
+    // The total time messages waited in `Admit()`.
+    std::chrono::milliseconds throttled{0};
+  };
+  /// Return the current state, and reset the accumulated counters.
+  Metrics ResetMetrics();
+
+ private:
+  void Release();
+  void AdjustIfNeeded(std::unique_lock<std::mutex> const&);
+
+  std::function<FlowSignals()> sample_;
+  FlowControllerOptions const options_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::size_t limit_;
+  std::size_t active_ = 0;
+  std::chrono::steady_clock::time_point next_adjust_;
+  Metrics metrics_;
+};
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_GETTING_STARTED_GKE_FLOW_CONTROLLER_H
@@ -13,6 +13,14 @@
 // limitations under the License.
 
 #include "gcs_indexing.h"
+#include "gke/completion_tracker.h"
+#include "gke/flow_controller.h"
+#include "gke/metrics.h"
+#include "gke/mutation_batcher.h"
+#include "gke/prefix_snapshot.h"
+#include "prefix_dispatcher.h"
+#include "split_policy.h"
+#include <absl/types/optional.h>
 #include <google/cloud/pubsub/publisher.h>
 #include <google/cloud/pubsub/subscriber.h>
 #include <google/cloud/spanner/client.h>
@@ -22,6 +30,7 @@
 #include <nlohmann/json.hpp>
 #include <algorithm>
 #include <atomic>
+#include <iterator>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -31,55 +40,89 @@ namespace {
 namespace gcs = ::google::cloud::storage;
 namespace pubsub = ::google::cloud::pubsub;
 namespace spanner = ::google::cloud::spanner;
-using google::cloud::future;
-using google::cloud::promise;
 using google::cloud::Status;
-using google::cloud::cpp_samples::ColumnCount;
+using google::cloud::cpp_samples::CompletionTracker;
+using google::cloud::cpp_samples::FlowController;
+using google::cloud::cpp_samples::FlowControllerOptions;
+using google::cloud::cpp_samples::FlowSignals;
+using google::cloud::cpp_samples::Counter;
+using google::cloud::cpp_samples::ExponentialBuckets;
 using google::cloud::cpp_samples::GetEnv;
-using google::cloud::cpp_samples::UpdateObjectMetadata;
-
-class MutationBatcher {
- public:
-  MutationBatcher(spanner::Client client);
-
-  future<Status> Push(gcs::ObjectMetadata const& o);
-  // Return the number of mutations processed since the last Flush().
-  std::int64_t Flush();
-
-  void ReapBackgroundTasks();
-
- private:
-  void FlushIfNeeded(std::unique_lock<std::mutex> const&);
-  void Flush(std::unique_lock<std::mutex> const&);
-
-  struct Item {
-    spanner::Mutation mutation;
-    promise<Status> done;
-  };
-
-  spanner::Client client_;
-  std::mutex mu_;
-  std::vector<Item> items_;
-  std::vector<std::future<void>> background_tasks_;
-  std::int64_t mutation_count_ = 0;
-};
+using google::cloud::cpp_samples::Histogram;
+using google::cloud::cpp_samples::MakeListingRangeMessage;
+using google::cloud::cpp_samples::MakePrefixListMessage;
+using google::cloud::cpp_samples::MetricsRegistry;
+using google::cloud::cpp_samples::MetricsServer;
+using google::cloud::cpp_samples::MutationBatcher;
+using google::cloud::cpp_samples::ParsePrefixList;
+using google::cloud::cpp_samples::PrefixSnapshot;
+using google::cloud::cpp_samples::PrefixDispatcher;
+using google::cloud::cpp_samples::SplitPolicy;
 
 void IndexGcsPrefix(pubsub::Message m, pubsub::AckHandler h, gcs::Client client,
                     pubsub::Publisher publisher,
-                    std::shared_ptr<MutationBatcher> batcher);
+                    std::shared_ptr<PrefixDispatcher> dispatcher,
+                    std::shared_ptr<MutationBatcher> batcher,
+                    absl::optional<spanner::Client> delta,
+                    FlowController::Admission admission);
 
-// Spanner limits a commit to 20,000 mutations, where each modified column
-// counts as a separate "mutation".
-auto constexpr kSpannerMutationLimit = 20'000UL;
-// Spanner recommends changing at most "a few hundred rows" at a time:
-//   https://cloud.google.com/spanner/docs/bulk-loading
-auto constexpr kEfficientRowLimit = 512UL;
 // The Cloud Pub/Sub service can flow control how many messages
-// are delivered to each subscriber.
+// are delivered to each subscriber. `FlowController` adjusts how many of
+// them are processed concurrently based on the health of Cloud Spanner.
 auto constexpr kMaxOutstandingMessages = 128;
 // The Cloud Pub/Sub library can be configured to limit the number of
 // messages that are not ack or nacked by the application.
 auto constexpr kMaxConcurrency = 256;
+// Request listing pages of this size (the service default), so the first
+// entry of each page can be identified to measure the page latency.
+auto constexpr kListPageSize = 1000;
+// Serve the Prometheus metrics on this port, unless overridden by the
+// `METRICS_PORT` environment variable.
+auto constexpr kDefaultMetricsPort = 9090;
+
+struct IndexerMetrics {
+  Histogram const& list_page_latency;
+  Counter const& objects_listed;
+  Counter const& prefixes_listed;
+  Counter const& messages_received;
+  Counter const& messages_nacked;
+  Histogram const& ack_latency;
+  Counter const& delta_unchanged;
+  Counter const& delta_deleted;
+  Counter const& delta_folders_deleted;
+};
+
+IndexerMetrics const& Metrics() {
+  static auto const* const metrics = [] {
+    auto& r = MetricsRegistry::Default();
+    return new IndexerMetrics{
+        r.AddHistogram("gcs_list_page_latency_seconds",
+                       "The time to fetch each page of a GCS listing.",
+                       ExponentialBuckets(0.005, 2, 12)),
+        r.AddCounter("gcs_objects_listed_total",
+                     "The number of objects listed."),
+        r.AddCounter("gcs_prefixes_listed_total",
+                     "The number of prefixes listed."),
+        r.AddCounter("pubsub_messages_received_total",
+                     "The number of Pub/Sub messages received."),
+        r.AddCounter("pubsub_messages_nacked_total",
+                     "The number of Pub/Sub messages nacked."),
+        r.AddHistogram(
+            "pubsub_ack_latency_seconds",
+            "The time from receiving a Pub/Sub message until it is acked.",
+            ExponentialBuckets(0.01, 2, 16)),
+        r.AddCounter("delta_objects_unchanged_total",
+                     "The number of listed objects skipped in delta mode."),
+        r.AddCounter("delta_rows_deleted_total",
+                     "The number of rows for missing objects deleted in delta"
+                     " mode."),
+        r.AddCounter("delta_folders_deleted_total",
+                     "The number of missing folders whose rows were deleted in"
+                     " delta mode."),
+    };
+  }();
+  return *metrics;
+}
 
 }  // namespace
 
@@ -91,10 +134,39 @@ int main(int argc, char* argv[]) try {
           GetEnv("SPANNER_DATABASE"))));
 
   auto batcher = std::make_shared<MutationBatcher>(spanner_client);
+  // In delta mode only new or changed objects are written, and the rows for
+  // deleted objects are removed, see `PrefixSnapshot` for details.
+  absl::optional<spanner::Client> delta;
+  auto const* mode = std::getenv("INDEX_MODE");
+  if (mode != nullptr && std::string(mode) == "delta") delta = spanner_client;
+  FlowControllerOptions flow_options;
+  flow_options.max_messages = kMaxOutstandingMessages;
+  auto flow = std::make_shared<FlowController>(
+      [b = batcher] {
+        return FlowSignals{b->PendingRows(), b->CommitLatencyEstimate()};
+      },
+      flow_options);
 
   auto publisher = pubsub::Publisher(pubsub::MakePublisherConnection(
       pubsub::Topic(GetEnv("GOOGLE_CLOUD_PROJECT"), GetEnv("TOPIC_ID")),
       pubsub::PublisherOptions{}));
+  auto dispatcher = std::make_shared<PrefixDispatcher>(publisher);
+
+  Metrics();  // Register the metrics before they are scraped.
+  auto& registry = MetricsRegistry::Default();
+  registry.AddGauge("batcher_pending_rows",
+                    "The number of rows waiting for a Spanner commit.",
+                    [b = batcher] {
+                      return static_cast<double>(b->PendingRows());
+                    });
+  registry.AddGauge("batcher_background_tasks",
+                    "The number of background commit tasks.",
+                    [b = batcher] {
+                      return static_cast<double>(b->BackgroundTaskCount());
+                    });
+  auto const* port = std::getenv("METRICS_PORT");
+  MetricsServer metrics_server(
+      registry, port == nullptr ? kDefaultMetricsPort : std::stoi(port));
 
   auto subscriber = pubsub::Subscriber(pubsub::MakeSubscriberConnection(
       pubsub::Subscription(GetEnv("GOOGLE_CLOUD_PROJECT"),
@@ -107,8 +179,10 @@ int main(int argc, char* argv[]) try {
   std::atomic<std::int64_t> message_count{0};
   auto session =
       subscriber.Subscribe([g = std::move(gcs_client), p = std::move(publisher),
-                            b = batcher, &message_count](auto m, auto h) {
-        IndexGcsPrefix(std::move(m), std::move(h), g, p, b);
+                            d = dispatcher, b = batcher, delta, f = flow,
+                            &message_count](auto m, auto h) {
+        IndexGcsPrefix(std::move(m), std::move(h), g, p, d, b, delta,
+                       f->Admit());
         ++message_count;
       });
   using namespace std::chrono_literals;
@@ -118,9 +192,26 @@ int main(int argc, char* argv[]) try {
     auto const messages = total_messages - last_message_count;
     last_message_count = total_messages;
     auto const mutations = batcher->Flush();
+    auto const prefixes = dispatcher->ResetMetrics();
+    auto const flow_metrics = flow->ResetMetrics();
     if (mutations == 0 && message_count == 0) continue;  // nothing to report
+    auto const& latency = batcher->CommitLatency();
+    using ms = std::chrono::duration<double, std::milli>;
     std::cout << __func__ << "() messages=" << messages
-              << ", mutations=" << mutations << std::endl;
+              << ", mutations=" << mutations
+              << ", prefixes=" << prefixes.scheduled
+              << ", duplicate_prefixes=" << prefixes.duplicates
+              << ", published=" << prefixes.messages
+              << ", publish_errors=" << prefixes.errors
+              << ", message_limit=" << flow_metrics.limit
+              << ", active_messages=" << flow_metrics.active
+              << ", limit_decreases=" << flow_metrics.decreases
+              << ", throttled_ms=" << flow_metrics.throttled.count()
+              << ", pending_rows=" << batcher->PendingRows()
+              << ", commits=" << latency.count() << ", commit_p50_ms="
+              << ms(latency.Percentile(0.50)).count() << ", commit_p90_ms="
+              << ms(latency.Percentile(0.90)).count() << ", commit_p99_ms="
+              << ms(latency.Percentile(0.99)).count() << std::endl;
   }
   auto status = session.get();
   if (status.ok()) return 0;
@@ -154,92 +245,21 @@ void LogError(std::string const& msg) {
   std::cerr << LogFormat("error", msg) << "\n";
 }
 
-MutationBatcher::MutationBatcher(spanner::Client client)
-    : client_(std::move(client)) {}
-
-future<Status> MutationBatcher::Push(gcs::ObjectMetadata const& o) {
-  std::unique_lock lk(mu_);
-  // Make room for the new data.
-  FlushIfNeeded(lk);
-  items_.push_back(Item{UpdateObjectMetadata(o), promise<Status>{}});
-  return items_.back().done.get_future();
-}
-
-std::int64_t MutationBatcher::Flush() {
-  std::unique_lock lk(mu_);
-  Flush(lk);
-  std::int64_t n = 0;
-  std::swap(n, mutation_count_);
-  return n;
-}
-
-void MutationBatcher::ReapBackgroundTasks() {
-  std::unique_lock lk(mu_);
-  // Remove any tasks that have completed. This would not be needed if
-  // we had a fully asynchronous `AsyncCommit()` function in Cloud Spanner.
-  background_tasks_.erase(
-      std::remove_if(background_tasks_.begin(), background_tasks_.end(),
-                     [](auto& t) {
-                       using namespace std::chrono_literals;
-                       return t.wait_for(10ms) == std::future_status::ready;
-                     }),
-      background_tasks_.end());
-}
-
-void MutationBatcher::FlushIfNeeded(std::unique_lock<std::mutex> const& lk) {
-  if (items_.size() >= kEfficientRowLimit) return Flush(lk);
-  if (items_.size() * ColumnCount() >= kSpannerMutationLimit) return Flush(lk);
-}
-
-void MutationBatcher::Flush(std::unique_lock<std::mutex> const&) {
-  if (items_.empty()) return;
-  std::vector<Item> items;
-  items.swap(items_);
-  mutation_count_ += items.size();
-  background_tasks_.push_back(std::async(
-      std::launch::async,
-      [](spanner::Client client, std::vector<Item> items) {
-        std::vector<spanner::Mutation> mutations(items.size());
-        std::transform(items.begin(), items.end(), mutations.begin(),
-                       [](auto& i) { return std::move(i.mutation); });
-        auto commit_result = client.Commit(std::move(mutations));
-        for (auto& i : items) i.done.set_value(commit_result.status());
-      },
-      client_, std::move(items)));
-}
-
-template <typename T>
-future<std::vector<future<T>>> when_all(std::vector<future<T>> w) {
-  class Accumulator : public std::enable_shared_from_this<Accumulator> {
-   public:
-    Accumulator() : unsatisfied_(0) {}
-
-    future<std::vector<future<T>>> Start(std::vector<future<T>> all) {
-      auto self = this->shared_from_this();
-      unsatisfied_ = all.size();
-      accumulator_.resize(all.size());
-      std::size_t i = 0;
-      for (auto& f : all) {
-        cont_.push_back(f.then([index = i++, self](future<T> g) {
-          self->OnCompletion(index, std::move(g));
-        }));
-      }
-      return done_.get_future();
-    }
-
-   private:
-    void OnCompletion(std::size_t index, future<T> g) {
-      accumulator_[index] = std::move(g);
-      if (--unsatisfied_ == 0) done_.set_value(std::move(accumulator_));
-    }
-    std::atomic<std::size_t> unsatisfied_;
-    std::vector<future<T>> accumulator_;
-    std::vector<future<void>> cont_;
-    google::cloud::promise<std::vector<future<T>>> done_;
-  };
-
-  auto accumulator = std::make_shared<Accumulator>();
-  return accumulator->Start(std::move(w));
+void LogCheckpoint(std::string const& bucket, std::string const& prefix,
+                   std::string const& position, SplitPolicy const& policy) {
+  std::cout << nlohmann::json{
+                   {"severity", "info"},
+                   {"message", "listing checkpoint"},
+                   {"bucket", bucket},
+                   {"prefix", prefix},
+                   {"position", position},
+                   {"entries", policy.entries()},
+                   {"progress", policy.progress()},
+                   {"entriesPerSecond", policy.rate()},
+                   {"estimatedRemainingSeconds",
+                    policy.estimated_remaining().count()},
+               }.dump()
+            << "\n";
 }
 
 template <class... Ts>
@@ -251,93 +271,184 @@ overloaded(Ts...) -> overloaded<Ts...>;
 
 void IndexGcsPrefix(pubsub::Message m, pubsub::AckHandler h, gcs::Client client,
                     pubsub::Publisher publisher,
-                    std::shared_ptr<MutationBatcher> batcher) {
-  auto deadline = std::chrono::steady_clock::now() + std::chrono::minutes(5);
+                    std::shared_ptr<PrefixDispatcher> dispatcher,
+                    std::shared_ptr<MutationBatcher> batcher,
+                    absl::optional<spanner::Client> delta,
+                    FlowController::Admission admission) {
+  auto const received = std::chrono::steady_clock::now();
+  auto deadline = received + std::chrono::minutes(5);
+  auto const& metrics = Metrics();
+  metrics.messages_received.Add();
   auto const attributes = m.attributes();
   auto i = attributes.find("bucket");
   if (i == attributes.end()) {
     return LogError("missing 'bucket' attribute in Pub/Sub message");
   }
   auto const bucket = i->second;
-  auto const prefix = [&attributes] {
+  // The message contains either a single prefix (and maybe a range within
+  // that prefix) in its attributes, or a list of prefixes created by
+  // `PrefixDispatcher`.
+  auto const prefixes = [&attributes, &m] {
     auto i = attributes.find("prefix");
-    if (i == attributes.end()) return gcs::Prefix();
-    return gcs::Prefix(i->second);
-  }();
-  auto const start = [&attributes] {
-    auto i = attributes.find("start");
-    if (i == attributes.end()) return gcs::StartOffset();
-    return gcs::StartOffset(i->second);
+    std::vector<gcs::Prefix> prefixes;
+    if (i != attributes.end()) {
+      prefixes.emplace_back(i->second);
+    } else if (m.data().empty()) {
+      prefixes.emplace_back();
+    } else {
+      for (auto& p : ParsePrefixList(m.data())) prefixes.emplace_back(p);
+    }
+    return prefixes;
   }();
+  auto attribute = [&attributes](char const* name) {
+    auto i = attributes.find(name);
+    if (i == attributes.end()) return std::string{};
+    return i->second;
+  };
+  auto start = attribute("start");
+  auto end = attribute("end");
+
+  // The message is acked (or nacked) once all the work it started completes.
+  // The ack handler is move-only, and the tracker callback must be copyable.
+  auto handler = std::make_shared<pubsub::AckHandler>(std::move(h));
+  auto tracker = CompletionTracker::Create(
+      [handler, batcher, admission = std::move(admission), received,
+       &metrics](Status status) {
+        if (status.ok()) {
+          std::move(*handler).ack();
+          metrics.ack_latency.Record(std::chrono::steady_clock::now() -
+                                     received);
+        } else {
+          std::move(*handler).nack();
+          metrics.messages_nacked.Add();
+          std::ostringstream os;
+          os << "One or more operations failed, first error " << status;
+          LogError(std::move(os).str());
+        }
+        // Once the operations (including any writes to Cloud Spanner) have
+        // completed we cleanup the background tasks that might have been
+        // created to satisfy the request.
+        batcher->ReapBackgroundTasks();
+      });
 
-  std::vector<google::cloud::future<google::cloud::Status>> pending;
-  for (auto const& entry : client.ListObjectsAndPrefixes(bucket, prefix, start,
-                                                         gcs::Delimiter("/"))) {
-    ThrowIfNotOkay("listing bucket " + bucket, entry.status());
-    if (std::chrono::steady_clock::now() >= deadline) {
-      std::string start = absl::visit(
-          overloaded{[](std::string const& s) { return s; },
-                     [](gcs::ObjectMetadata const& o) { return o.name(); }},
+  auto const function = std::string(__func__);
+  auto index_prefix = [&](gcs::Prefix const& prefix) {
+    auto const prefix_name =
+        prefix.has_value() ? prefix.value() : std::string{};
+    SplitPolicy policy(prefix_name, start, end, deadline);
+    auto const start_offset =
+        start.empty() ? gcs::StartOffset() : gcs::StartOffset(start);
+    auto const end_offset =
+        end.empty() ? gcs::EndOffset() : gcs::EndOffset(end);
+    absl::optional<PrefixSnapshot> snapshot;
+    if (delta) snapshot.emplace(*delta, bucket, prefix_name, start, end);
+    // Delete the rows for objects not found in the listing, which covered
+    // the names before `covered_end` (or all names if it is empty).
+    auto reconcile = [&](std::string const& covered_end) {
+      if (!snapshot) return;
+      auto mutations = snapshot->Reconcile(covered_end);
+      metrics.delta_unchanged.Add(snapshot->unchanged());
+      metrics.delta_deleted.Add(snapshot->deleted());
+      metrics.delta_folders_deleted.Add(snapshot->deleted_folders());
+      auto status = mutations.status();
+      if (mutations) {
+        for (auto& m : *mutations) {
+          status = delta->Commit(spanner::Mutations{std::move(m)}).status();
+          if (!status.ok()) break;
+        }
+      }
+      tracker->Add();
+      tracker->Done(status);
+    };
+
+    std::int64_t listed = 0;
+    auto fetch_start = std::chrono::steady_clock::now();
+    for (auto const& entry : client.ListObjectsAndPrefixes(
+             bucket, prefix, start_offset, end_offset, gcs::Delimiter("/"),
+             gcs::MaxResults(kListPageSize))) {
+      // The iterator only blocks to fetch a new page.
+      if (listed++ % kListPageSize == 0) {
+        metrics.list_page_latency.Record(std::chrono::steady_clock::now() -
+                                         fetch_start);
+      }
+      ThrowIfNotOkay("listing bucket " + bucket, entry.status());
+      auto const& name = absl::visit(
+          overloaded{
+              [](std::string const& s) -> std::string const& { return s; },
+              [](gcs::ObjectMetadata const& o) -> std::string const& {
+                return o.name();
+              }},
           *entry);
-      auto builder = pubsub::MessageBuilder{}
-                         .InsertAttribute("bucket", bucket)
-                         .InsertAttribute("start", std::move(start));
-      std::cout << __func__ << "(" << prefix << ") split at " << start
-                << std::endl;
-      if (prefix.has_value()) {
-        builder.InsertAttribute("prefix", prefix.value());
+      // Another worker took over the rest of the range.
+      if (policy.Done(name)) break;
+      auto decision = policy.OnEntry(name);
+      if (decision.checkpoint) {
+        LogCheckpoint(bucket, prefix_name, name, policy);
+      }
+      for (auto const& range : decision.handoff) {
+        std::cout << function << "(" << prefix_name << ") split ["
+                  << range.start << ", " << range.end << ")" << std::endl;
+        tracker->Track(
+            publisher
+                .Publish(MakeListingRangeMessage(bucket, prefix_name, range))
+                .then([](auto f) { return f.get().status(); }));
       }
-      pending.push_back(
-          publisher.Publish(std::move(builder).Build()).then([](auto f) {
-            return f.get().status();
-          }));
-      break;
+      if (decision.stop) {
+        reconcile(name);
+        return false;
+      }
+
+      absl::visit(
+          overloaded{
+              [&](std::string const& p) {
+                // Do not reschedule the same prefix we are processing.
+                if (prefix.has_value() && prefix.value() == p) return;
+                if (snapshot) {
+                  ThrowIfNotOkay("reading index for " + bucket,
+                                 snapshot->SkipPrefix(p));
+                }
+                metrics.prefixes_listed.Add();
+                tracker->Track(dispatcher->Schedule(bucket, p));
+              },
+              [&](gcs::ObjectMetadata const& o) {
+                metrics.objects_listed.Add();
+                if (snapshot) {
+                  auto changed = snapshot->Changed(o);
+                  ThrowIfNotOkay("reading index for " + bucket,
+                                 changed.status());
+                  if (!*changed) return;
+                }
+                batcher->Push(o, tracker);
+              }},
+          *entry);
+      fetch_start = std::chrono::steady_clock::now();
     }
+    reconcile(policy.end());
+    return true;
+  };
 
-    pending.push_back(absl::visit(
-        overloaded{
-            [&](std::string const& p) {
-              // Do not reschedule the same prefix we are processing.
-              if (prefix.has_value() && prefix.value() == p) {
-                return make_ready_future(Status{});
-              }
-              return publisher
-                  .Publish(pubsub::MessageBuilder{}
-                               .InsertAttribute("bucket", bucket)
-                               .InsertAttribute("prefix", p)
-                               .Build())
-                  .then([](auto f) { return f.get().status(); });
-            },
-            [&](gcs::ObjectMetadata const& o) { return batcher->Push(o); }},
-        *entry));
+  for (auto p = prefixes.begin(); p != prefixes.end(); ++p) {
+    if (index_prefix(*p)) {
+      start.clear();
+      end.clear();
+      continue;
+    }
+    // Out of time, reschedule the prefixes we did not get to.
+    std::vector<std::string> remaining;
+    for (auto r = std::next(p); r != prefixes.end(); ++r) {
+      remaining.push_back(r->value());
+    }
+    if (remaining.empty()) break;
+    tracker->Track(
+        publisher.Publish(MakePrefixListMessage(bucket, std::move(remaining)))
+            .then([](auto f) { return f.get().status(); }));
+    break;
   }
+  dispatcher->Flush();
 
-  when_all(std::move(pending))
-      .then([handler = std::move(h), fun = std::string(__func__), bucket,
-             prefix](auto f) mutable {
-        auto v = f.get();
-        std::vector<google::cloud::Status> results(v.size());
-        std::transform(v.begin(), v.end(), results.begin(),
-                       [](auto&& g) { return g.get(); });
-        auto const success = std::all_of(results.begin(), results.end(),
-                                         [](auto&& s) { return s.ok(); });
-        if (success) return std::move(handler).ack();
-        std::move(handler).nack();
-        std::ostringstream os;
-        os << "One or more operations failed, first error ";
-        for (auto const& s : results) {
-          if (s.ok()) continue;
-          os << s;
-          break;
-        }
-        LogError(std::move(os).str());
-      })
-      .then([batcher](auto f) {
-        // Once the operations (including any writes to Cloud Spanner) have
-        // completed we cleanup the background tasks that might have been
-        // created to satisfy the request.
-        batcher->ReapBackgroundTasks();
-      });
+  // All the operations have started, release the reference held by this
+  // function.
+  tracker->Done(Status{});
 }
 
 }  // namespace
@@ -0,0 +1,449 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measure the end-to-end throughput of `gke_index_gcs` using local emulators.
+//
+// The benchmark seeds a bucket in the storage emulator with a synthetic tree
+// of objects, creates the Pub/Sub topic and subscription, and the Spanner
+// instance and database used by the indexer. It then starts the indexer as a
+// child process, publishes a message to index the full bucket, and waits
+// until all the objects appear in the `gcs_objects` table.
+//
+//   gcloud emulators spanner start &
+//   gcloud beta emulators pubsub start --host-port=localhost:8085 &
+//   python3 -m testbench --port 9000 &
+//   export SPANNER_EMULATOR_HOST=localhost:9010
+//   export PUBSUB_EMULATOR_HOST=localhost:8085
+//   export CLOUD_STORAGE_EMULATOR_ENDPOINT=http://localhost:9000
+//   export GOOGLE_CLOUD_PROJECT=test-project
+//   ./indexer_benchmark ./gke_index_gcs gcs_objects.sql \
+//       [object-count] [depth] [fan-out] [timeout-seconds]
+//
+// The synthetic bucket places `object-count` objects in a tree of folders
+// `depth` levels deep, with `fan-out` sub-folders in each folder. The report
+// includes objects indexed/s, Pub/Sub messages/s, the commit latency
+// percentiles reported by the indexer, and its peak RSS.
+
+#include "gcs_indexing.h"
+#include <google/cloud/pubsub/publisher.h>
+#include <google/cloud/pubsub/subscription_admin_client.h>
+#include <google/cloud/pubsub/topic_admin_client.h>
+#include <google/cloud/spanner/client.h>
+#include <google/cloud/spanner/database_admin_client.h>
+#include <google/cloud/spanner/instance_admin_client.h>
+#include <google/cloud/storage/client.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+namespace gcs = ::google::cloud::storage;
+namespace pubsub = ::google::cloud::pubsub;
+namespace spanner = ::google::cloud::spanner;
+using google::cloud::cpp_samples::GetEnv;
+using Clock = std::chrono::steady_clock;
+using seconds = std::chrono::duration<double>;
+
+struct Config {
+  std::string indexer;
+  std::string schema;
+  std::int64_t object_count = 10'000;
+  int depth = 3;
+  int fan_out = 8;
+  std::chrono::seconds timeout = std::chrono::minutes(10);
+};
+
+void ThrowIfNotOkay(std::string const& context,
+                    google::cloud::Status const& status) {
+  if (status.ok()) return;
+  std::ostringstream os;
+  os << "error while " << context << " status=" << status;
+  throw std::runtime_error(std::move(os).str());
+}
+
+// Tolerate resources created by a previous run of the benchmark.
+void ThrowIfNotOkayOrExists(std::string const& context,
+                            google::cloud::Status const& status) {
+  if (status.code() == google::cloud::StatusCode::kAlreadyExists) return;
+  ThrowIfNotOkay(context, status);
+}
+
+std::string RandomSuffix() {
+  auto gen = std::mt19937_64(std::random_device{}());
+  return std::to_string(
+      std::uniform_int_distribution<std::uint32_t>(0, 999'999'999)(gen));
+}
+
+// The name of the @p i-th object: its folder is given by the digits of @p i
+// in base `fan_out`, so consecutive objects are spread across the tree.
+std::string ObjectName(Config const& config, std::int64_t i) {
+  std::string name;
+  auto n = i;
+  for (int level = 0; level != config.depth; ++level) {
+    name += "folder-" + std::to_string(n % config.fan_out) + "/";
+    n /= config.fan_out;
+  }
+  return name + "object-" + std::to_string(i);
+}
+
+void SeedBucket(Config const& config, std::string const& project,
+                std::string const& bucket) {
+  auto client = gcs::Client();
+  ThrowIfNotOkay("creating bucket " + bucket,
+                 client.CreateBucketForProject(bucket, project,
+                                               gcs::BucketMetadata{})
+                     .status());
+
+  auto const start = Clock::now();
+  std::atomic<std::int64_t> next{0};
+  auto worker = [&] {
+    for (auto i = next++; i < config.object_count; i = next++) {
+      auto const name = ObjectName(config, i);
+      ThrowIfNotOkay("creating object " + name,
+                     client.InsertObject(bucket, name, name).status());
+    }
+  };
+  auto const thread_count =
+      (std::max)(4U, 4 * std::thread::hardware_concurrency());
+  std::vector<std::future<void>> tasks(thread_count);
+  for (auto& t : tasks) t = std::async(std::launch::async, worker);
+  for (auto& t : tasks) t.get();
+  auto const elapsed =
+      std::chrono::duration_cast<seconds>(Clock::now() - start);
+  std::cout << "seeded " << config.object_count << " objects in " << bucket
+            << ", elapsed=" << elapsed.count() << "s" << std::endl;
+}
+
+void CreateTopic(pubsub::Topic const& topic,
+                 pubsub::Subscription const& subscription) {
+  auto topics = pubsub::TopicAdminClient(pubsub::MakeTopicAdminConnection());
+  ThrowIfNotOkayOrExists(
+      "creating topic " + topic.FullName(),
+      topics.CreateTopic(pubsub::TopicBuilder(topic)).status());
+  auto subscriptions = pubsub::SubscriptionAdminClient(
+      pubsub::MakeSubscriptionAdminConnection());
+  ThrowIfNotOkayOrExists(
+      "creating subscription " + subscription.FullName(),
+      subscriptions
+          .CreateSubscription(topic, subscription,
+                              pubsub::SubscriptionBuilder{}.set_ack_deadline(
+                                  std::chrono::seconds(600)))
+          .status());
+}
+
+// Read the DDL statements in the schema file, dropping `--` comments.
+std::vector<std::string> LoadSchema(std::string const& filename) {
+  std::ifstream is(filename);
+  if (!is) throw std::runtime_error("cannot open " + filename);
+  std::string text;
+  for (std::string line; std::getline(is, line);) {
+    auto const comment = line.find("--");
+    if (comment != std::string::npos) line.erase(comment);
+    text += line + "\n";
+  }
+  std::vector<std::string> statements;
+  std::istringstream ss(text);
+  for (std::string s; std::getline(ss, s, ';');) {
+    if (s.find_first_not_of(" \t\n") == std::string::npos) continue;
+    statements.push_back(std::move(s));
+  }
+  return statements;
+}
+
+void CreateDatabase(Config const& config, spanner::Database const& db) {
+  auto instances =
+      spanner::InstanceAdminClient(spanner::MakeInstanceAdminConnection());
+  auto const instance = db.instance();
+  ThrowIfNotOkayOrExists(
+      "creating instance " + instance.FullName(),
+      instances
+          .CreateInstance(spanner::CreateInstanceRequestBuilder(
+                              instance, "projects/" + instance.project_id() +
+                                            "/instanceConfigs/emulator-config")
+                              .SetNodeCount(1)
+                              .Build())
+          .get()
+          .status());
+  auto databases =
+      spanner::DatabaseAdminClient(spanner::MakeDatabaseAdminConnection());
+  ThrowIfNotOkay("creating database " + db.FullName(),
+                 databases.CreateDatabase(db, LoadSchema(config.schema))
+                     .get()
+                     .status());
+}
+
+std::int64_t CountRows(spanner::Client client, std::string const& bucket) {
+  auto rows = client.ExecuteQuery(spanner::SqlStatement(
+      "SELECT COUNT(*) FROM gcs_objects WHERE bucket = @bucket",
+      {{"bucket", spanner::Value(bucket)}}));
+  for (auto const& row : spanner::StreamOf<std::tuple<std::int64_t>>(rows)) {
+    ThrowIfNotOkay("counting rows", row.status());
+    return std::get<0>(*row);
+  }
+  return 0;
+}
+
+/// Tracks the metrics printed by the indexer on its standard output.
+class IndexerOutput {
+ public:
+  void OnLine(std::string const& line) {
+    std::lock_guard lk(mu_);
+    for (auto const& [key, value] : Parse(line)) {
+      // The message count is reported per interval, the commit latency
+      // percentiles are cumulative.
+      if (key == "messages") {
+        messages_ += static_cast<std::int64_t>(value);
+      } else {
+        latest_[key] = value;
+      }
+    }
+  }
+
+  std::int64_t messages() const {
+    std::lock_guard lk(mu_);
+    return messages_;
+  }
+  double latest(std::string const& key) const {
+    std::lock_guard lk(mu_);
+    auto i = latest_.find(key);
+    return i == latest_.end() ? 0 : i->second;
+  }
+
+ private:
+  // Parse the `key=value` pairs in a report line, such as:
+  //   main() messages=12, mutations=345, ..., commit_p50_ms=12.5
+  static std::map<std::string, double> Parse(std::string const& line) {
+    std::map<std::string, double> values;
+    if (line.rfind("main()", 0) != 0) return values;
+    std::istringstream is(line.substr(6));
+    for (std::string token; std::getline(is, token, ',');) {
+      auto const eq = token.find('=');
+      if (eq == std::string::npos) continue;
+      auto const b = token.find_first_not_of(' ');
+      values[token.substr(b, eq - b)] = std::atof(token.c_str() + eq + 1);
+    }
+    return values;
+  }
+
+  mutable std::mutex mu_;
+  std::int64_t messages_ = 0;
+  std::map<std::string, double> latest_;
+};
+
+/// Runs the indexer in a child process, with its output piped back to us.
+class IndexerProcess {
+ public:
+  IndexerProcess(std::string const& path,
+                 std::vector<std::pair<std::string, std::string>> const& env) {
+    // The parent is multi-threaded, the child can only make async-signal-safe
+    // calls between `fork()` and `execve()`. Prepare everything it needs
+    // before forking.
+    std::vector<std::string> variables;
+    for (auto** e = environ; *e != nullptr; ++e) {
+      std::string v = *e;
+      auto const overridden = std::any_of(
+          env.begin(), env.end(),
+          [&v](auto const& kv) { return v.rfind(kv.first + "=", 0) == 0; });
+      if (!overridden) variables.push_back(std::move(v));
+    }
+    for (auto const& [name, value] : env) {
+      variables.push_back(name + "=" + value);
+    }
+    std::vector<char*> envp;
+    for (auto& v : variables) envp.push_back(v.data());
+    envp.push_back(nullptr);
+    auto arg0 = path;
+    char* argv[] = {arg0.data(), nullptr};
+    auto const error = "cannot run " + path + "\n";
+
+    int fds[2];
+    if (pipe(fds) != 0) throw std::runtime_error("cannot create pipe");
+    pid_ = fork();
+    if (pid_ < 0) throw std::runtime_error("cannot fork indexer process");
+    if (pid_ == 0) {
+      close(fds[0]);
+      dup2(fds[1], STDOUT_FILENO);
+      execve(path.c_str(), argv, envp.data());
+      (void)write(STDERR_FILENO, error.data(), error.size());
+      _exit(127);
+    }
+    close(fds[1]);
+    output_ = fdopen(fds[0], "r");
+  }
+  ~IndexerProcess() {
+    if (pid_ > 0) Stop();
+    if (output_ != nullptr) std::fclose(output_);
+  }
+
+  /// Call @p f for each line printed by the indexer, until it exits.
+  template <typename Functor>
+  void ForEachLine(Functor&& f) {
+    char* line = nullptr;
+    std::size_t capacity = 0;
+    for (ssize_t n; (n = getline(&line, &capacity, output_)) != -1;) {
+      f(std::string(line, n));
+    }
+    std::free(line);
+  }
+
+  /// Terminate the indexer and return its peak RSS in KiB.
+  long Stop() {
+    if (pid_ <= 0) return 0;
+    kill(pid_, SIGTERM);
+    int status;
+    struct rusage usage {};
+    wait4(pid_, &status, 0, &usage);
+    pid_ = -1;
+    return usage.ru_maxrss;
+  }
+
+ private:
+  pid_t pid_ = -1;
+  std::FILE* output_ = nullptr;
+};
+
+Config ParseArgs(int argc, char* argv[]) {
+  if (argc < 3) {
+    throw std::runtime_error(
+        "usage: indexer_benchmark <indexer-path> <schema.sql> [object-count]"
+        " [depth] [fan-out] [timeout-seconds]");
+  }
+  Config config;
+  config.indexer = argv[1];
+  config.schema = argv[2];
+  if (argc > 3) config.object_count = std::stoll(argv[3]);
+  if (argc > 4) config.depth = std::stoi(argv[4]);
+  if (argc > 5) config.fan_out = (std::max)(1, std::stoi(argv[5]));
+  if (argc > 6) config.timeout = std::chrono::seconds(std::stol(argv[6]));
+  return config;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) try {
+  auto const config = ParseArgs(argc, argv);
+  // The benchmark creates (and fills) buckets, topics and databases, refuse to
+  // run against production services.
+  for (auto const* name : {"CLOUD_STORAGE_EMULATOR_ENDPOINT",
+                           "PUBSUB_EMULATOR_HOST", "SPANNER_EMULATOR_HOST"}) {
+    if (std::getenv(name) == nullptr) {
+      throw std::runtime_error(std::string(name) + " is not set, this"
+                               " benchmark only runs against emulators");
+    }
+  }
+
+  auto const project = GetEnv("GOOGLE_CLOUD_PROJECT");
+  auto const suffix = RandomSuffix();
+  auto const bucket = "indexer-benchmark-" + suffix;
+  auto const topic = pubsub::Topic(project, "indexer-benchmark-" + suffix);
+  auto const subscription =
+      pubsub::Subscription(project, "indexer-benchmark-" + suffix);
+  auto const db = spanner::Database(project, "indexer-benchmark",
+                                    "benchmark-" + suffix.substr(0, 9));
+
+  SeedBucket(config, project, bucket);
+  CreateTopic(topic, subscription);
+  CreateDatabase(config, db);
+
+  IndexerProcess indexer(config.indexer,
+                         {{"SPANNER_INSTANCE", db.instance().instance_id()},
+                          {"SPANNER_DATABASE", db.database_id()},
+                          {"TOPIC_ID", topic.topic_id()},
+                          {"SUBSCRIPTION_ID", subscription.subscription_id()},
+                          // Let the kernel pick a free port, so the benchmark
+                          // can run next to another indexer.
+                          {"METRICS_PORT", "0"}});
+  IndexerOutput output;
+  auto reader = std::thread([&] {
+    indexer.ForEachLine([&](std::string const& line) {
+      std::cout << "indexer: " << line << std::flush;
+      output.OnLine(line);
+    });
+  });
+  // If anything below throws, stop the indexer, which ends its output, and
+  // join the reader. Destroying a joinable thread calls `std::terminate()`.
+  struct ReaderGuard {
+    IndexerProcess& indexer;
+    std::thread& reader;
+    ~ReaderGuard() {
+      if (!reader.joinable()) return;
+      indexer.Stop();
+      reader.join();
+    }
+  } reader_guard{indexer, reader};
+
+  auto const start = Clock::now();
+  auto publisher = pubsub::Publisher(pubsub::MakePublisherConnection(topic));
+  ThrowIfNotOkay("publishing initial message",
+                 publisher
+                     .Publish(pubsub::MessageBuilder{}
+                                  .InsertAttribute("bucket", bucket)
+                                  .Build())
+                     .get()
+                     .status());
+
+  auto client = spanner::Client(spanner::MakeConnection(db));
+  std::int64_t indexed = 0;
+  auto const deadline = start + config.timeout;
+  while (indexed < config.object_count && Clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    indexed = CountRows(client, bucket);
+  }
+  auto const elapsed =
+      std::chrono::duration_cast<seconds>(Clock::now() - start);
+  // The indexer reports its metrics every 10 seconds, wait for the last report
+  // before stopping it.
+  std::this_thread::sleep_for(std::chrono::seconds(11));
+  auto const peak_rss_kib = indexer.Stop();
+  reader.join();
+
+  if (indexed < config.object_count) {
+    std::cout << "TIMEOUT: only " << indexed << " of " << config.object_count
+              << " objects indexed\n";
+  }
+  std::cout << "objects=" << indexed << ", depth=" << config.depth
+            << ", fan_out=" << config.fan_out
+            << ", elapsed=" << elapsed.count() << "s"
+            << ", objects/s=" << static_cast<double>(indexed) / elapsed.count()
+            << ", messages=" << output.messages() << ", messages/s="
+            << static_cast<double>(output.messages()) / elapsed.count()
+            << ", commits=" << output.latest("commits")
+            << ", commit_p50_ms=" << output.latest("commit_p50_ms")
+            << ", commit_p90_ms=" << output.latest("commit_p90_ms")
+            << ", commit_p99_ms=" << output.latest("commit_p99_ms")
+            << ", peak_rss_mib=" << static_cast<double>(peak_rss_kib) / 1024
+            << std::endl;
+  return indexed < config.object_count ? 1 : 0;
+} catch (std::exception const& ex) {
+  std::cerr << "Standard C++ exception thrown: " << ex.what() << "\n";
+  return 1;
+}
@@ -0,0 +1,87 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_GETTING_STARTED_GKE_LATENCY_HISTOGRAM_H
+#define CPP_SAMPLES_GETTING_STARTED_GKE_LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace google::cloud::cpp_samples {
+
+/**
+ * A lock-free histogram of latencies.
+ *
+ * The buckets grow exponentially, with 4 buckets per power of 2, so the
+ * percentiles are accurate to about 20%. Latencies from 1us to over an hour
+ * are tracked.
+ */
+class LatencyHistogram {
+ public:
+  static auto constexpr kBucketsPerOctave = 4;
+  static auto constexpr kBucketCount = 32 * kBucketsPerOctave;
+
+  void Record(std::chrono::steady_clock::duration latency) {
+    auto const us =
+        std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+    counts_[Bucket(us)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::int64_t count() const {
+    std::int64_t total = 0;
+    for (auto const& c : counts_) total += c.load(std::memory_order_relaxed);
+    return total;
+  }
+
+  /// The latency below which @p p (in [0, 1]) of the samples fall.
+  std::chrono::microseconds Percentile(double p) const {
+    auto const total = count();
+    if (total == 0) return std::chrono::microseconds(0);
+    auto const target = static_cast<std::int64_t>(std::ceil(p * total));
+    std::int64_t seen = 0;
+    for (int b = 0; b != kBucketCount; ++b) {
+      seen += counts_[b].load(std::memory_order_relaxed);
+      if (seen >= (std::max)(target, std::int64_t{1})) return UpperBound(b);
+    }
+    return UpperBound(kBucketCount - 1);
+  }
+
+  /// The (exclusive) upper bound for the values in bucket @p b.
+  static std::chrono::microseconds UpperBound(int b) {
+    return std::chrono::microseconds(static_cast<std::int64_t>(
+        std::exp2(static_cast<double>(b + 1) / kBucketsPerOctave)));
+  }
+
+  std::int64_t bucket_count(int b) const {
+    return counts_[b].load(std::memory_order_relaxed);
+  }
+
+ private:
+  static int Bucket(std::int64_t us) {
+    if (us <= 1) return 0;
+    auto const b = static_cast<int>(std::log2(static_cast<double>(us)) *
+                                    kBucketsPerOctave);
+    return (std::min)(b, kBucketCount - 1);
+  }
+
+  std::array<std::atomic<std::int64_t>, kBucketCount> counts_{};
+};
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_GETTING_STARTED_GKE_LATENCY_HISTOGRAM_H
@@ -0,0 +1,239 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gke/metrics.h"
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace google::cloud::cpp_samples {
+
+void Counter::Add(std::int64_t n) const {
+  MetricsRegistry::Increment(slot_, n);
+}
+
+void Histogram::Record(double value) const {
+  // Prometheus buckets are inclusive, `le` is "less than or equal".
+  auto const bucket = static_cast<std::size_t>(
+      std::lower_bound(bounds_.begin(), bounds_.end(), value) -
+      bounds_.begin());
+  MetricsRegistry::Increment(slot_ + bucket, 1);
+  MetricsRegistry::Increment(slot_ + bounds_.size() + 1,
+                             std::llround(value * 1e6));
+}
+
+std::vector<double> ExponentialBuckets(double start, double factor,
+                                       int count) {
+  std::vector<double> bounds;
+  for (auto b = start; count > 0; --count, b *= factor) bounds.push_back(b);
+  return bounds;
+}
+
+Counter const& MetricsRegistry::AddCounter(std::string name,
+                                           std::string help) {
+  std::lock_guard lk(mu_);
+  auto counter = std::unique_ptr<Counter>(new Counter(Allocate(1)));
+  families_.push_back(
+      Family{std::move(name), std::move(help), std::move(counter), {}, {}});
+  return *families_.back().counter;
+}
+
+Histogram const& MetricsRegistry::AddHistogram(std::string name,
+                                               std::string help,
+                                               std::vector<double> bounds) {
+  std::lock_guard lk(mu_);
+  std::sort(bounds.begin(), bounds.end());
+  auto const slot = Allocate(bounds.size() + 2);
+  auto histogram =
+      std::unique_ptr<Histogram>(new Histogram(slot, std::move(bounds)));
+  families_.push_back(
+      Family{std::move(name), std::move(help), {}, std::move(histogram), {}});
+  return *families_.back().histogram;
+}
+
+void MetricsRegistry::AddGauge(std::string name, std::string help,
+                               std::function<double()> value) {
+  std::lock_guard lk(mu_);
+  families_.push_back(
+      Family{std::move(name), std::move(help), {}, {}, std::move(value)});
+}
+
+std::string MetricsRegistry::Scrape() {
+  std::ostringstream os;
+  std::vector<Family const*> gauges;
+  {
+    std::lock_guard lk(mu_);
+    for (auto const& f : families_) {
+      if (f.gauge) {
+        gauges.push_back(&f);
+        continue;
+      }
+      os << "# HELP " << f.name << " " << f.help << "\n";
+      if (f.counter) {
+        os << "# TYPE " << f.name << " counter\n"
+           << f.name << " " << Sum(lk, f.counter->slot_) << "\n";
+        continue;
+      }
+      auto const& h = *f.histogram;
+      os << "# TYPE " << f.name << " histogram\n";
+      std::int64_t count = 0;
+      for (std::size_t i = 0; i != h.bounds_.size(); ++i) {
+        count += Sum(lk, h.slot_ + i);
+        os << f.name << "_bucket{le=\"" << h.bounds_[i] << "\"} " << count
+           << "\n";
+      }
+      count += Sum(lk, h.slot_ + h.bounds_.size());
+      os << f.name << "_bucket{le=\"+Inf\"} " << count << "\n"
+         << f.name << "_sum "
+         << static_cast<double>(Sum(lk, h.slot_ + h.bounds_.size() + 1)) / 1e6
+         << "\n"
+         << f.name << "_count " << count << "\n";
+    }
+  }
+  // Gauges may acquire locks in other components, which may in turn update
+  // metrics, do not hold the registry lock while sampling them. Families are
+  // never removed, so the pointers remain valid.
+  for (auto const* f : gauges) {
+    os << "# HELP " << f->name << " " << f->help << "\n"
+       << "# TYPE " << f->name << " gauge\n"
+       << f->name << " " << f->gauge() << "\n";
+  }
+  return std::move(os).str();
+}
+
+MetricsRegistry& MetricsRegistry::Default() {
+  // Never destroyed, threads may still update metrics during shutdown.
+  static auto* const registry = new MetricsRegistry;
+  return *registry;
+}
+
+void MetricsRegistry::Increment(std::size_t slot, std::int64_t n) {
+  // Each thread owns a shard, which is folded into the retired counts when
+  // the thread exits.
+  struct Handle {
+    Shard* shard = nullptr;
+    ~Handle() {
+      if (shard != nullptr) Default().Retire(shard);
+    }
+  };
+  thread_local Handle handle;
+  if (handle.shard == nullptr) {
+    handle.shard = Default().Register(std::make_unique<Shard>());
+  }
+  // Only this thread writes to the slot, an atomic increment is not needed.
+  auto& v = handle.shard->values[slot];
+  v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void MetricsRegistry::Retire(Shard* shard) {
+  std::lock_guard lk(mu_);
+  for (std::size_t i = 0; i != kMaxSlots; ++i) {
+    retired_[i] += shard->values[i].load(std::memory_order_relaxed);
+  }
+  shards_.erase(std::remove_if(shards_.begin(), shards_.end(),
+                               [shard](auto const& s) {
+                                 return s.get() == shard;
+                               }),
+                shards_.end());
+}
+
+std::size_t MetricsRegistry::Allocate(std::size_t slots) {
+  if (next_slot_ + slots > kMaxSlots) {
+    throw std::runtime_error("too many metrics registered");
+  }
+  auto const slot = next_slot_;
+  next_slot_ += slots;
+  return slot;
+}
+
+MetricsRegistry::Shard* MetricsRegistry::Register(
+    std::unique_ptr<Shard> shard) {
+  std::lock_guard lk(mu_);
+  shards_.push_back(std::move(shard));
+  return shards_.back().get();
+}
+
+std::int64_t MetricsRegistry::Sum(std::lock_guard<std::mutex> const&,
+                                  std::size_t slot) {
+  auto total = retired_[slot];
+  for (auto const& s : shards_) {
+    total += s->values[slot].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+MetricsServer::MetricsServer(MetricsRegistry& registry, int port)
+    : registry_(registry), fd_(socket(AF_INET, SOCK_STREAM, 0)) {
+  if (fd_ < 0) throw std::runtime_error("cannot create metrics socket");
+  int on = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(static_cast<std::uint16_t>(port));
+  if (bind(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+      listen(fd_, 16) != 0) {
+    close(fd_);
+    throw std::runtime_error("cannot listen on metrics port " +
+                             std::to_string(port));
+  }
+  thread_ = std::thread([this] { Serve(); });
+}
+
+MetricsServer::~MetricsServer() {
+  shutdown_ = true;
+  // Unblocks the `accept()` call in the serving thread.
+  shutdown(fd_, SHUT_RDWR);
+  thread_.join();
+  close(fd_);
+}
+
+void MetricsServer::Serve() {
+  while (!shutdown_) {
+    auto const connection = accept(fd_, nullptr, nullptr);
+    if (connection < 0) {
+      if (shutdown_) break;
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      // Other errors, such as running out of file descriptors, are likely to
+      // persist. Back off instead of spinning on them.
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      continue;
+    }
+    // The request is ignored, every path returns the metrics.
+    char buffer[4096];
+    (void)read(connection, buffer, sizeof(buffer));
+    auto const body = registry_.Scrape();
+    auto const response =
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " +
+        std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    for (std::size_t offset = 0; offset < response.size();) {
+      // The scraper may disconnect at any time, this must not raise SIGPIPE.
+      auto const n = send(connection, response.data() + offset,
+                          response.size() - offset, MSG_NOSIGNAL);
+      if (n <= 0) break;
+      offset += static_cast<std::size_t>(n);
+    }
+    close(connection);
+  }
+}
+
+}  // namespace google::cloud::cpp_samples
@@ -0,0 +1,150 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_GETTING_STARTED_GKE_METRICS_H
+#define CPP_SAMPLES_GETTING_STARTED_GKE_METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace google::cloud::cpp_samples {
+
+class MetricsRegistry;
+
+/**
+ * A monotonic counter.
+ *
+ * Each thread increments its own copy of the counter, without any
+ * synchronization with other threads. The copies are added up when the
+ * metrics are scraped.
+ */
+class Counter {
+ public:
+  void Add(std::int64_t n = 1) const;
+
+ private:
+  friend class MetricsRegistry;
+  explicit Counter(std::size_t slot) : slot_(slot) {}
+  std::size_t slot_;
+};
+
+/// A histogram with fixed bucket boundaries, using thread-local counters.
+class Histogram {
+ public:
+  void Record(double value) const;
+  void Record(std::chrono::steady_clock::duration latency) const {
+    Record(std::chrono::duration<double>(latency).count());
+  }
+
+ private:
+  friend class MetricsRegistry;
+  Histogram(std::size_t slot, std::vector<double> bounds)
+      : slot_(slot), bounds_(std::move(bounds)) {}
+  // Uses `bounds_.size() + 1` slots for the bucket counts, and one more for
+  // the sum of the values, in micro-units.
+  std::size_t slot_;
+  std::vector<double> bounds_;
+};
+
+/// Exponential bucket boundaries: @p start, @p start * @p factor, ...
+std::vector<double> ExponentialBuckets(double start, double factor, int count);
+
+/**
+ * A minimal registry of metrics, exported in the Prometheus text format.
+ *
+ * Metrics are registered once, usually at startup, and updated from any
+ * thread. The hot path is a relaxed load and store on a thread-local slot,
+ * all the aggregation happens in `Scrape()`. There is a single registry per
+ * process, see `Default()`.
+ */
+class MetricsRegistry {
+ public:
+  static auto constexpr kMaxSlots = 512;
+
+  Counter const& AddCounter(std::string name, std::string help);
+  Histogram const& AddHistogram(std::string name, std::string help,
+                                std::vector<double> bounds);
+  /// A gauge is sampled from @p value when the metrics are scraped.
+  void AddGauge(std::string name, std::string help,
+                std::function<double()> value);
+
+  /// Return all the metrics in the Prometheus text exposition format.
+  std::string Scrape();
+
+  /// The registry for this process.
+  static MetricsRegistry& Default();
+
+ private:
+  friend class Counter;
+  friend class Histogram;
+  struct Shard {
+    std::array<std::atomic<std::int64_t>, kMaxSlots> values{};
+  };
+
+  MetricsRegistry() = default;
+  static void Increment(std::size_t slot, std::int64_t n);
+  void Retire(Shard* shard);
+  std::size_t Allocate(std::size_t slots);
+  Shard* Register(std::unique_ptr<Shard> shard);
+  std::int64_t Sum(std::lock_guard<std::mutex> const&, std::size_t slot);
+
+  struct Family {
+    std::string name;
+    std::string help;
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Histogram> histogram;
+    std::function<double()> gauge;
+  };
+
+  std::mutex mu_;
+  std::size_t next_slot_ = 0;
+  // A deque keeps the families at stable addresses as new ones are added.
+  std::deque<Family> families_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+  // The counts of threads that have exited.
+  std::array<std::int64_t, kMaxSlots> retired_{};
+};
+
+/**
+ * Serves the metrics in a registry over HTTP.
+ *
+ * This is a minimal server, sufficient for a Prometheus scraper: it answers
+ * every request, one at a time, with the output of `Scrape()`.
+ */
+class MetricsServer {
+ public:
+  MetricsServer(MetricsRegistry& registry, int port);
+  ~MetricsServer();
+
+ private:
+  void Serve();
+
+  MetricsRegistry& registry_;
+  int fd_;
+  std::atomic<bool> shutdown_{false};
+  std::thread thread_;
+};
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_GETTING_STARTED_GKE_METRICS_H
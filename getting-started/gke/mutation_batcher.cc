@@ -0,0 +1,268 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gke/mutation_batcher.h"
+#include "gcs_indexing.h"
+#include "gke/metrics.h"
+#include <algorithm>
+#include <tuple>
+
+namespace google::cloud::cpp_samples {
+
+namespace gcs = ::google::cloud::storage;
+namespace spanner = ::google::cloud::spanner;
+
+namespace {
+
+struct BatcherMetrics {
+  Histogram const& commit_latency;
+  Histogram const& commit_rows;
+  Counter const& commit_errors;
+};
+
+BatcherMetrics const& Metrics() {
+  static auto const* const metrics = [] {
+    auto& r = MetricsRegistry::Default();
+    return new BatcherMetrics{
+        r.AddHistogram("spanner_commit_latency_seconds",
+                       "The latency of each Spanner commit.",
+                       ExponentialBuckets(0.001, 2, 16)),
+        r.AddHistogram("spanner_commit_rows",
+                       "The number of rows in each Spanner commit.",
+                       ExponentialBuckets(1, 2, 15)),
+        r.AddCounter("spanner_commit_errors_total",
+                     "The number of failed Spanner commits."),
+    };
+  }();
+  return *metrics;
+}
+
+}  // namespace
+
+MutationBatcher::MutationBatcher(spanner::Client client,
+                                 MutationBatcherOptions options)
+    : client_(std::move(client)),
+      options_(std::move(options)),
+      row_target_(options_.max_rows),
+      linger_([this] { LingerLoop(); }) {
+  Metrics();  // Register the metrics before they are scraped.
+}
+
+MutationBatcher::~MutationBatcher() {
+  {
+    std::unique_lock lk(mu_);
+    shutdown_ = true;
+    cv_.notify_all();
+    room_cv_.notify_all();
+  }
+  linger_.join();
+  std::vector<std::future<void>> tasks;
+  {
+    std::unique_lock lk(mu_);
+    Flush(lk);
+    tasks.swap(background_tasks_);
+  }
+  for (auto& t : tasks) t.get();
+}
+
+void MutationBatcher::Push(gcs::ObjectMetadata const& o,
+                           std::shared_ptr<CompletionTracker> tracker) {
+  // Convert the row before taking the lock, into an arena reused by each
+  // thread. Only copying its strings to the batch arena needs the lock.
+  thread_local BatchArena scratch;
+  scratch.Reset();
+  ArenaRow staged;
+  auto const bytes = MakeArenaRow(o, scratch, staged);
+
+  std::unique_lock lk(mu_);
+  // Apply backpressure to the caller (and indirectly to the Pub/Sub
+  // subscriber) while too many rows are waiting for their commit.
+  if (pending_rows_ >= options_.max_pending_rows) {
+    Flush(lk);
+    room_cv_.wait(lk, [this] {
+      return shutdown_ || pending_rows_ < options_.max_pending_rows;
+    });
+  }
+  // Make room for the new row if it would not fit in the current batch.
+  if (batch_ &&
+      (pending_bytes_ + bytes > options_.target_bytes ||
+       (batch_->items.size() + 1) * ColumnCount() > kSpannerMutationLimit)) {
+    Flush(lk);
+  }
+  if (!batch_) batch_ = std::make_shared<Batch>();
+  if (batch_->items.empty()) {
+    oldest_ = std::chrono::steady_clock::now();
+    cv_.notify_one();
+  }
+  auto& row = batch_->rows.emplace_back();
+  CopyArenaRow(staged, batch_->arena, row);
+  pending_bytes_ += bytes;
+  tracker->Add();
+  batch_->items.push_back(Item{&row, std::move(tracker)});
+  ++pending_rows_;
+  FlushIfNeeded(lk);
+}
+
+std::int64_t MutationBatcher::Flush() {
+  std::unique_lock lk(mu_);
+  Flush(lk);
+  std::int64_t n = 0;
+  std::swap(n, mutation_count_);
+  return n;
+}
+
+std::size_t MutationBatcher::PendingRows() {
+  std::unique_lock lk(mu_);
+  return pending_rows_;
+}
+
+std::chrono::milliseconds MutationBatcher::CommitLatencyEstimate() {
+  std::unique_lock lk(mu_);
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      latency_estimate_);
+}
+
+std::size_t MutationBatcher::BackgroundTaskCount() {
+  std::unique_lock lk(mu_);
+  return background_tasks_.size();
+}
+
+void MutationBatcher::ReapBackgroundTasks() {
+  std::unique_lock lk(mu_);
+  // Remove any tasks that have completed. This would not be needed if
+  // we had a fully asynchronous `AsyncCommit()` function in Cloud Spanner.
+  background_tasks_.erase(
+      std::remove_if(background_tasks_.begin(), background_tasks_.end(),
+                     [](auto& t) {
+                       using namespace std::chrono_literals;
+                       return t.wait_for(10ms) == std::future_status::ready;
+                     }),
+      background_tasks_.end());
+}
+
+void MutationBatcher::FlushIfNeeded(std::unique_lock<std::mutex> const& lk) {
+  if (!batch_) return;
+  auto const rows = batch_->items.size();
+  if (rows >= row_target_) return Flush(lk);
+  if (pending_bytes_ >= options_.target_bytes) return Flush(lk);
+  if ((rows + 1) * ColumnCount() > kSpannerMutationLimit) return Flush(lk);
+}
+
+void MutationBatcher::Flush(std::unique_lock<std::mutex> const& lk) {
+  if (!batch_ || batch_->items.empty()) return;
+  auto batch = std::move(batch_);
+  pending_bytes_ = 0;
+  auto& items = batch->items;
+  mutation_count_ += items.size();
+
+  auto key = [](Item const& i) {
+    auto const& row = *i.row;
+    return std::make_tuple(row[Index(ObjectColumn::kBucket)].string,
+                           row[Index(ObjectColumn::kName)].string,
+                           row[Index(ObjectColumn::kGeneration)].number);
+  };
+  // A stable sort keeps repeated updates to the same key in the order they
+  // were pushed, the last one wins when the partition is committed.
+  std::stable_sort(
+      items.begin(), items.end(),
+      [&key](auto const& a, auto const& b) { return key(a) < key(b); });
+  auto const partitions = std::clamp<std::size_t>(
+      items.size() / (std::max)(options_.min_partition_rows, std::size_t{1}),
+      1, (std::max)(options_.max_partitions, std::size_t{1}));
+
+  auto const partition_size = (items.size() + partitions - 1) / partitions;
+  std::size_t begin = 0;
+  while (begin != items.size()) {
+    auto end = (std::min)(begin + partition_size, items.size());
+    // Partitions are committed concurrently, all the updates for a key must
+    // be in the same partition, or their order would be lost.
+    while (end != items.size() && key(items[end]) == key(items[end - 1])) {
+      ++end;
+    }
+    Commit(lk, batch, begin, end);
+    begin = end;
+  }
+}
+
+void MutationBatcher::Commit(std::unique_lock<std::mutex> const&,
+                             std::shared_ptr<Batch> batch, std::size_t begin,
+                             std::size_t end) {
+  // Each task owns a reference to the batch, its memory is released once the
+  // last partition is committed.
+  background_tasks_.push_back(std::async(
+      std::launch::async,
+      [this, begin, end](spanner::Client client, std::shared_ptr<Batch> batch) {
+        auto const items = batch->items.begin();
+        std::vector<ArenaRow const*> rows;
+        rows.reserve(end - begin);
+        for (auto i = items + begin; i != items + end; ++i) {
+          rows.push_back(i->row);
+        }
+        auto const start = std::chrono::steady_clock::now();
+        auto commit_result =
+            client.Commit(spanner::Mutations{MakeUpsert(rows)});
+        auto const latency = std::chrono::steady_clock::now() - start;
+        commit_latency_.Record(latency);
+        auto const& metrics = Metrics();
+        metrics.commit_latency.Record(latency);
+        metrics.commit_rows.Record(static_cast<double>(end - begin));
+        if (!commit_result) metrics.commit_errors.Add();
+        OnCommit(latency, end - begin);
+        ++commit_count_;
+        for (auto i = items + begin; i != items + end; ++i) {
+          i->tracker->Done(commit_result.status());
+        }
+      },
+      client_, std::move(batch)));
+}
+
+void MutationBatcher::LingerLoop() {
+  std::unique_lock lk(mu_);
+  while (!shutdown_) {
+    if (!batch_ || batch_->items.empty()) {
+      cv_.wait(lk, [this] {
+        return shutdown_ || (batch_ && !batch_->items.empty());
+      });
+      continue;
+    }
+    auto const deadline = oldest_ + options_.max_linger;
+    if (cv_.wait_until(lk, deadline, [this] { return shutdown_; })) break;
+    // The batch may have been flushed, and a new one started, while we waited.
+    if (!batch_ || batch_->items.empty()) continue;
+    if (std::chrono::steady_clock::now() < oldest_ + options_.max_linger) {
+      continue;
+    }
+    Flush(lk);
+  }
+}
+
+void MutationBatcher::OnCommit(std::chrono::steady_clock::duration latency,
+                               std::size_t rows) {
+  std::unique_lock lk(mu_);
+  pending_rows_ -= rows;
+  room_cv_.notify_all();
+  latency_estimate_ = latency_estimate_ == std::chrono::steady_clock::duration{}
+                          ? latency
+                          : (latency_estimate_ * 7 + latency) / 8;
+  // Additive increase, multiplicative decrease: grow the batches while Spanner
+  // keeps up, back off quickly when commits slow down.
+  if (latency > options_.target_commit_latency) {
+    row_target_ = (std::max)(options_.min_rows, row_target_ / 2);
+    return;
+  }
+  row_target_ =
+      (std::min)(options_.max_rows, row_target_ + options_.row_increment);
+}
+
+}  // namespace google::cloud::cpp_samples
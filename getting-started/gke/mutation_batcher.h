@@ -0,0 +1,154 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_GETTING_STARTED_GKE_MUTATION_BATCHER_H
+#define CPP_SAMPLES_GETTING_STARTED_GKE_MUTATION_BATCHER_H
+
+#include "gke/batch_arena.h"
+#include "gke/completion_tracker.h"
+#include "gke/latency_histogram.h"
+#include <google/cloud/future.h>
+#include <google/cloud/spanner/client.h>
+#include <google/cloud/spanner/mutations.h>
+#include <google/cloud/status.h>
+#include <google/cloud/storage/object_metadata.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace google::cloud::cpp_samples {
+
+// Spanner limits a commit to 20,000 mutations, where each modified column
+// counts as a separate "mutation".
+auto constexpr kSpannerMutationLimit = 20'000UL;
+// Spanner recommends changing at most "a few hundred rows" at a time:
+//   https://cloud.google.com/spanner/docs/bulk-loading
+auto constexpr kEfficientRowLimit = 512UL;
+
+/// Controls when a `MutationBatcher` sends its pending rows to Spanner.
+struct MutationBatcherOptions {
+  // Flush a batch once its oldest row has waited this long, even if the batch
+  // is small. This bounds the ack latency when traffic is low.
+  std::chrono::milliseconds max_linger = std::chrono::milliseconds(250);
+  // Flush a batch before the serialized size of its rows would exceed this
+  // many bytes. A single larger row is committed on its own.
+  std::size_t target_bytes = 1024 * 1024;
+  // The batcher adapts the number of rows per commit between these limits,
+  // growing the batch while commits complete faster than
+  // `target_commit_latency`, and halving it when commits are slower.
+  std::size_t min_rows = 32;
+  std::size_t max_rows = kEfficientRowLimit;
+  std::size_t row_increment = 32;
+  std::chrono::milliseconds target_commit_latency =
+      std::chrono::milliseconds(500);
+  // Each batch is sorted by primary key and split into at most this many
+  // contiguous key ranges, which are committed in parallel. A partition
+  // contains at least `min_partition_rows` rows.
+  std::size_t max_partitions = 4;
+  std::size_t min_partition_rows = 64;
+  // `Push()` blocks while this many rows are waiting to be committed. This
+  // bounds the memory used by the batcher when Spanner falls behind.
+  std::size_t max_pending_rows = 32 * kEfficientRowLimit;
+};
+
+/**
+ * Aggregates object metadata updates into Spanner commits.
+ *
+ * Each call to `Push()` adds an operation to a `CompletionTracker`, which is
+ * marked as done once the commit containing that row completes. Commits run
+ * in background threads.
+ *
+ * The `gcs_objects` table is keyed by (bucket, name, generation). A batch of
+ * rows scattered across the key space would touch many Spanner splits, and
+ * each split participating in a commit adds to its cost. The batcher sorts
+ * each batch by key and commits contiguous key ranges as separate
+ * transactions, so each commit involves fewer splits.
+ *
+ * The pending rows are stored in a `BatchArena` owned by the batch, and only
+ * converted to Spanner values when the batch is committed. Each commit sends
+ * a single multi-row mutation, and all the memory for a batch is released at
+ * once when its last commit completes.
+ */
+class MutationBatcher {
+ public:
+  explicit MutationBatcher(spanner::Client client,
+                           MutationBatcherOptions options = {});
+  ~MutationBatcher();
+
+  void Push(storage::ObjectMetadata const& o,
+            std::shared_ptr<CompletionTracker> tracker);
+  // Return the number of mutations processed since the last Flush().
+  std::int64_t Flush();
+  // Return the number of commits completed since the batcher was created.
+  std::int64_t CommitCount() const { return commit_count_.load(); }
+  // The distribution of commit latencies since the batcher was created.
+  LatencyHistogram const& CommitLatency() const { return commit_latency_; }
+  // The number of rows pushed, but not yet committed.
+  std::size_t PendingRows();
+  // An exponentially weighted moving average of the recent commit latencies.
+  std::chrono::milliseconds CommitLatencyEstimate();
+  // The number of background commit tasks not yet reaped.
+  std::size_t BackgroundTaskCount();
+
+  void ReapBackgroundTasks();
+
+ private:
+  struct Item {
+    ArenaRow const* row;
+    std::shared_ptr<CompletionTracker> tracker;
+  };
+  struct Batch {
+    BatchArena arena;
+    // A deque keeps the rows at stable addresses as the batch grows.
+    std::deque<ArenaRow> rows;
+    std::vector<Item> items;
+  };
+
+  void FlushIfNeeded(std::unique_lock<std::mutex> const&);
+  void Flush(std::unique_lock<std::mutex> const&);
+  void Commit(std::unique_lock<std::mutex> const&, std::shared_ptr<Batch> batch,
+              std::size_t begin, std::size_t end);
+  void LingerLoop();
+  void OnCommit(std::chrono::steady_clock::duration latency, std::size_t rows);
+
+  spanner::Client client_;
+  MutationBatcherOptions const options_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::condition_variable room_cv_;
+  bool shutdown_ = false;
+  std::shared_ptr<Batch> batch_;
+  std::size_t pending_bytes_ = 0;
+  std::size_t pending_rows_ = 0;
+  std::chrono::steady_clock::duration latency_estimate_{};
+  std::chrono::steady_clock::time_point oldest_;
+  std::size_t row_target_;
+  std::vector<std::future<void>> background_tasks_;
+  std::int64_t mutation_count_ = 0;
+  std::atomic<std::int64_t> commit_count_{0};
+  LatencyHistogram commit_latency_;
+  std::thread linger_;
+};
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_GETTING_STARTED_GKE_MUTATION_BATCHER_H
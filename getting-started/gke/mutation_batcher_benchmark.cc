@@ -0,0 +1,128 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measure the commit throughput of `MutationBatcher` for different key range
+// partitioning settings.
+//
+// This is intended to run against the Spanner emulator, with a database
+// created using `gcs_objects.sql`:
+//
+//   gcloud emulators spanner start &
+//   export SPANNER_EMULATOR_HOST=localhost:9010
+//   ... create the instance and database ...
+//   ./mutation_batcher_benchmark [row-count] [partitions...]
+
+#include "gcs_indexing.h"
+#include "gke/mutation_batcher.h"
+#include <google/cloud/spanner/client.h>
+#include <google/cloud/storage/internal/object_metadata_parser.h>
+#include <nlohmann/json.hpp>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+namespace gcs = ::google::cloud::storage;
+namespace spanner = ::google::cloud::spanner;
+using google::cloud::Status;
+using google::cloud::cpp_samples::CompletionTracker;
+using google::cloud::cpp_samples::GetEnv;
+using google::cloud::cpp_samples::MutationBatcher;
+using google::cloud::cpp_samples::MutationBatcherOptions;
+
+std::vector<gcs::ObjectMetadata> MakeObjects(std::int64_t count) {
+  auto gen = std::mt19937_64(std::random_device{}());
+  auto const run = std::uniform_int_distribution<std::uint64_t>()(gen);
+  auto random_prefix = [&gen] {
+    return std::to_string(std::uniform_int_distribution<int>(0, 999)(gen));
+  };
+  std::vector<gcs::ObjectMetadata> objects;
+  objects.reserve(count);
+  for (std::int64_t i = 0; i != count; ++i) {
+    auto const json = nlohmann::json{
+        {"bucket", "benchmark-bucket-" + std::to_string(i % 4)},
+        {"name", random_prefix() + "/run-" + std::to_string(run) +
+                     "/object-" + std::to_string(i)},
+        {"generation", std::to_string(1'000'000 + i)},
+        {"metageneration", "1"},
+        {"timeCreated", "2021-07-01T12:00:00.123Z"},
+        {"updated", "2021-07-01T12:00:00.123Z"},
+        {"storageClass", "STANDARD"},
+        {"size", std::to_string(i * 1024)},
+        {"crc32c", "AAAAAA=="},
+        {"md5Hash", "1B2M2Y8AsgTpgAmY7PhCfg=="},
+        {"contentType", "application/octet-stream"},
+        {"etag", "CAE="},
+    };
+    objects.push_back(
+        gcs::internal::ObjectMetadataParser::FromString(json.dump()).value());
+  }
+  return objects;
+}
+
+void RunBenchmark(spanner::Client client, std::size_t partitions,
+                  std::vector<gcs::ObjectMetadata> const& objects) {
+  auto options = MutationBatcherOptions{};
+  options.max_partitions = partitions;
+  MutationBatcher batcher(std::move(client), options);
+
+  auto const start = std::chrono::steady_clock::now();
+  std::promise<void> done;
+  auto tracker =
+      CompletionTracker::Create([&done](Status) { done.set_value(); });
+  for (auto const& o : objects) batcher.Push(o, tracker);
+  batcher.Flush();
+  tracker->Done(Status{});
+  done.get_future().get();
+  auto const errors = tracker->failures();
+  using seconds = std::chrono::duration<double>;
+  auto const elapsed = std::chrono::duration_cast<seconds>(
+      std::chrono::steady_clock::now() - start);
+  auto const commits = batcher.CommitCount();
+
+  std::cout << "partitions=" << partitions << ", rows=" << objects.size()
+            << ", commits=" << commits << ", errors=" << errors
+            << ", elapsed=" << elapsed.count() << "s"
+            << ", commits/s=" << static_cast<double>(commits) / elapsed.count()
+            << ", rows/s=" << static_cast<double>(objects.size()) /
+                                  elapsed.count()
+            << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) try {
+  if (std::getenv("SPANNER_EMULATOR_HOST") == nullptr) {
+    std::cerr << "WARNING: SPANNER_EMULATOR_HOST is not set, this benchmark"
+              << " will write to a production Spanner database\n";
+  }
+  auto const row_count = argc > 1 ? std::stoll(argv[1]) : 100'000LL;
+  std::vector<std::size_t> partitions;
+  for (int i = 2; i < argc; ++i) partitions.push_back(std::stoul(argv[i]));
+  if (partitions.empty()) partitions = {1, 2, 4, 8};
+
+  auto client = spanner::Client(spanner::MakeConnection(spanner::Database(
+      GetEnv("GOOGLE_CLOUD_PROJECT"), GetEnv("SPANNER_INSTANCE"),
+      GetEnv("SPANNER_DATABASE"))));
+
+  for (auto p : partitions) RunBenchmark(client, p, MakeObjects(row_count));
+  return 0;
+} catch (std::exception const& ex) {
+  std::cerr << "Standard C++ exception thrown: " << ex.what() << "\n";
+  return 1;
+}
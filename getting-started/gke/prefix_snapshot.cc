@@ -0,0 +1,202 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gke/prefix_snapshot.h"
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+namespace google::cloud::cpp_samples {
+
+namespace spanner = ::google::cloud::spanner;
+using std::chrono::system_clock;
+
+namespace {
+
+// Each deleted key or range counts as a mutation, keep each delete well below
+// the commit limit.
+auto constexpr kMaxDeletesPerMutation = 1000;
+
+}  // namespace
+
+std::string PrefixEnd(std::string prefix) {
+  while (!prefix.empty()) {
+    auto& c = prefix.back();
+    if (static_cast<unsigned char>(c) != 0xff) {
+      ++c;
+      return prefix;
+    }
+    prefix.pop_back();
+  }
+  return prefix;
+}
+
+PrefixSnapshot::PrefixSnapshot(spanner::Client client, std::string bucket,
+                               std::string prefix, std::string const& start,
+                               std::string const& end)
+    : client_(std::move(client)),
+      bucket_(std::move(bucket)),
+      prefix_(std::move(prefix)),
+      lower_((std::max)(prefix_, start)),
+      upper_(PrefixEnd(prefix_)) {
+  if (!end.empty() && (upper_.empty() || end < upper_)) upper_ = end;
+}
+
+StatusOr<bool> PrefixSnapshot::Changed(storage::ObjectMetadata const& o) {
+  auto status = Advance(o.name());
+  if (!status.ok()) return status;
+  auto changed = true;
+  while (row_ && row_->name == o.name()) {
+    if (row_->generation != o.generation()) {
+      DeleteRow(*row_);
+    } else {
+      // The time is stored with microsecond precision.
+      auto const delta = o.updated() - row_->updated;
+      changed = delta >= std::chrono::microseconds(1) ||
+                delta <= -std::chrono::microseconds(1);
+    }
+    status = Next();
+    if (!status.ok()) return status;
+  }
+  ++(changed ? changed_ : unchanged_);
+  return changed;
+}
+
+Status PrefixSnapshot::SkipPrefix(std::string const& prefix) {
+  // The listing may return the prefix being listed.
+  if (prefix.size() <= prefix_.size()) return {};
+  auto status = Advance(prefix);
+  if (!status.ok()) return status;
+  if (!row_ || row_->name.compare(0, prefix.size(), prefix) != 0) return {};
+  auto const folder_end = PrefixEnd(prefix);
+  if (folder_end.empty()) {
+    row_.reset();
+    return {};
+  }
+  return Query(folder_end);
+}
+
+StatusOr<std::vector<spanner::Mutation>> PrefixSnapshot::Reconcile(
+    std::string const& covered_end) {
+  auto status = Advance(covered_end);
+  if (!status.ok()) return status;
+  FlushDeletes();
+  return std::move(mutations_);
+}
+
+Status PrefixSnapshot::Query(std::string const& name) {
+  // Reading a range of the primary key, in key order, is a range scan.
+  std::string sql = R"sql(
+      SELECT name, generation, updated
+        FROM gcs_objects
+       WHERE bucket = @bucket
+         AND name >= @lower)sql";
+  std::map<std::string, spanner::Value> params{
+      {"bucket", spanner::Value(bucket_)},
+      {"lower", spanner::Value(name)},
+  };
+  if (!upper_.empty()) {
+    sql += " AND name < @upper";
+    params.emplace("upper", spanner::Value(upper_));
+  }
+  sql += " ORDER BY name, generation";
+  stream_ = std::make_unique<spanner::RowStream>(client_.ExecuteQuery(
+      spanner::SqlStatement(std::move(sql), std::move(params))));
+  next_ = stream_->begin();
+  return Next();
+}
+
+Status PrefixSnapshot::Next() {
+  if (next_ == stream_->end()) {
+    row_.reset();
+    return {};
+  }
+  using RowType = std::tuple<std::string, std::int64_t,
+                             absl::optional<spanner::Timestamp>>;
+  auto& row = *next_;
+  if (!row) return std::move(row).status();
+  auto values = row->get<RowType>();
+  if (!values) return std::move(values).status();
+  auto& [name, generation, updated] = *values;
+  auto tp = system_clock::time_point{};
+  if (updated) {
+    auto t = updated->get<system_clock::time_point>();
+    if (t) tp = *t;
+  }
+  row_ = Row{std::move(name), generation, tp};
+  ++next_;
+  return {};
+}
+
+Status PrefixSnapshot::Advance(std::string const& name) {
+  if (!started_) {
+    started_ = true;
+    auto status = Query(lower_);
+    if (!status.ok()) return status;
+  }
+  auto const& bound = name.empty() ? upper_ : name;
+  while (row_ && (name.empty() || row_->name < name)) {
+    auto const folder = Folder(row_->name);
+    if (folder.empty()) {
+      DeleteRow(*row_);
+      auto status = Next();
+      if (!status.ok()) return status;
+      continue;
+    }
+    // The listing is past this folder, and did not return it, so all its
+    // objects were deleted. Only delete the folder if it is entirely within
+    // the listed range, e.g., a range handed off by another worker may start
+    // in the middle of a folder.
+    auto const folder_end = PrefixEnd(folder);
+    if (folder_end.empty()) {
+      row_.reset();
+      break;
+    }
+    if (folder >= lower_ && (bound.empty() || folder_end <= bound)) {
+      DeleteFolder(folder, folder_end);
+    }
+    auto status = Query(folder_end);
+    if (!status.ok()) return status;
+  }
+  return {};
+}
+
+std::string PrefixSnapshot::Folder(std::string const& name) const {
+  auto const pos = name.find('/', prefix_.size());
+  if (pos == std::string::npos) return {};
+  return name.substr(0, pos + 1);
+}
+
+void PrefixSnapshot::DeleteRow(Row const& row) {
+  deletes_.AddKey(spanner::MakeKey(bucket_, row.name, row.generation));
+  ++deleted_;
+  if (++delete_count_ == kMaxDeletesPerMutation) FlushDeletes();
+}
+
+void PrefixSnapshot::DeleteFolder(std::string const& folder,
+                                  std::string const& folder_end) {
+  deletes_.AddRange(spanner::MakeKeyBoundClosed(bucket_, folder),
+                    spanner::MakeKeyBoundOpen(bucket_, folder_end));
+  ++deleted_folders_;
+  if (++delete_count_ == kMaxDeletesPerMutation) FlushDeletes();
+}
+
+void PrefixSnapshot::FlushDeletes() {
+  if (delete_count_ == 0) return;
+  mutations_.push_back(spanner::MakeDeleteMutation("gcs_objects", deletes_));
+  deletes_ = spanner::KeySet();
+  delete_count_ = 0;
+}
+
+}  // namespace google::cloud::cpp_samples
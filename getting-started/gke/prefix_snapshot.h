@@ -0,0 +1,128 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_GETTING_STARTED_GKE_PREFIX_SNAPSHOT_H
+#define CPP_SAMPLES_GETTING_STARTED_GKE_PREFIX_SNAPSHOT_H
+
+#include <absl/types/optional.h>
+#include <google/cloud/spanner/client.h>
+#include <google/cloud/spanner/keys.h>
+#include <google/cloud/spanner/mutations.h>
+#include <google/cloud/status.h>
+#include <google/cloud/status_or.h>
+#include <google/cloud/storage/object_metadata.h>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace google::cloud::cpp_samples {
+
+/// The smallest string greater than all the strings starting with @p prefix,
+/// empty if there is no such string.
+std::string PrefixEnd(std::string prefix);
+
+/**
+ * Compares the listing of a prefix against its indexed rows.
+ *
+ * In delta mode the indexer reads the rows for a prefix (or a range within
+ * the prefix) as it lists it. Objects whose generation and `updated` time
+ * match their row are not written again. Rows not matched by a listed object
+ * refer to deleted objects (or non-current generations), and are removed from
+ * the index.
+ *
+ * The listing and the rows are both sorted by name, the snapshot streams the
+ * rows in the range `[prefix, PrefixEnd(prefix))` and merges them with the
+ * listing entries, so it only holds one row at a time. The listing uses `/`
+ * as a delimiter: when it returns a sub-folder, the rows in that folder are
+ * skipped by restarting the query past the folder, they are reconciled by the
+ * listing of the sub-folder. Rows in a sub-folder the listing did not return
+ * belong to a deleted folder, and are removed with a single range delete.
+ * Each row is read by the listing of its own folder, plus at most one row per
+ * sub-folder.
+ *
+ * Call `Changed()` and `SkipPrefix()` in the order of the listing.
+ */
+class PrefixSnapshot {
+ public:
+  /// Compare the listing of [@p start, @p end) under @p prefix. An empty
+  /// @p start or @p end leave the range unbounded on that side.
+  PrefixSnapshot(spanner::Client client, std::string bucket,
+                 std::string prefix, std::string const& start,
+                 std::string const& end);
+
+  /// Returns true if @p o is new or changed, and must be written.
+  StatusOr<bool> Changed(storage::ObjectMetadata const& o);
+
+  /// The listing returned the sub-folder @p prefix.
+  Status SkipPrefix(std::string const& prefix);
+
+  /**
+   * Create the mutations to reconcile the index after the listing.
+   *
+   * The listing covered names before @p covered_end, or the full range if it
+   * is empty. The rows in that range not matched by `Changed()` are deleted.
+   */
+  StatusOr<std::vector<spanner::Mutation>> Reconcile(
+      std::string const& covered_end);
+
+  std::int64_t unchanged() const { return unchanged_; }
+  std::int64_t changed() const { return changed_; }
+  /// The number of rows deleted by the `Reconcile()` mutations.
+  std::int64_t deleted() const { return deleted_; }
+  /// The number of folders deleted by the `Reconcile()` mutations.
+  std::int64_t deleted_folders() const { return deleted_folders_; }
+
+ private:
+  struct Row {
+    std::string name;
+    std::int64_t generation;
+    std::chrono::system_clock::time_point updated;
+  };
+
+  // Read the rows starting at @p name.
+  Status Query(std::string const& name);
+  Status Next();
+  // Reconcile the rows before @p name, all the rows if it is empty.
+  Status Advance(std::string const& name);
+  // The sub-folder containing @p name, empty if @p name is directly under the
+  // prefix.
+  std::string Folder(std::string const& name) const;
+  void DeleteRow(Row const& row);
+  void DeleteFolder(std::string const& folder, std::string const& folder_end);
+  void FlushDeletes();
+
+  spanner::Client client_;
+  std::string bucket_;
+  std::string prefix_;
+  // The rows are in [lower_, upper_), an empty `upper_` is unbounded.
+  std::string lower_;
+  std::string upper_;
+  bool started_ = false;
+  std::unique_ptr<spanner::RowStream> stream_;
+  spanner::RowStreamIterator next_;
+  absl::optional<Row> row_;
+  spanner::KeySet deletes_;
+  std::size_t delete_count_ = 0;
+  std::vector<spanner::Mutation> mutations_;
+  std::int64_t unchanged_ = 0;
+  std::int64_t changed_ = 0;
+  std::int64_t deleted_ = 0;
+  std::int64_t deleted_folders_ = 0;
+};
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_GETTING_STARTED_GKE_PREFIX_SNAPSHOT_H
@@ -32,6 +32,9 @@ spec:
     metadata:
       labels:
         run: worker
+      annotations:
+        prometheus.io/scrape: 'true'
+        prometheus.io/port: '9090'
     spec:
       serviceAccountName: worker
       containers:
@@ -39,6 +42,9 @@ spec:
         image: gcr.io/{{project}}/getting-started-cpp/gke
         imagePullPolicy: Always
         command: [ '/r/gke_index_gcs' ]
+        ports:
+        - name: metrics
+          containerPort: 9090
         env:
         - name: SPANNER_INSTANCE
           value: getting-started-cpp
@@ -13,12 +13,16 @@
 // limitations under the License.
 
 #include "gcs_indexing.h"
+#include "prefix_dispatcher.h"
+#include "split_policy.h"
+#include <cppcodec/base64_rfc4648.hpp>
 #include <google/cloud/functions/http_request.h>
 #include <google/cloud/functions/http_response.h>
 #include <google/cloud/pubsub/publisher.h>
 #include <google/cloud/spanner/client.h>
 #include <google/cloud/storage/client.h>
 #include <nlohmann/json.hpp>
+#include <iterator>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -30,6 +34,11 @@ namespace gcs = ::google::cloud::storage;
 namespace pubsub = ::google::cloud::pubsub;
 namespace spanner = ::google::cloud::spanner;
 using google::cloud::cpp_samples::GetEnv;
+using google::cloud::cpp_samples::MakeListingRangeMessage;
+using google::cloud::cpp_samples::MakePrefixListMessage;
+using google::cloud::cpp_samples::ParsePrefixList;
+using google::cloud::cpp_samples::PrefixDispatcher;
+using google::cloud::cpp_samples::SplitPolicy;
 using google::cloud::cpp_samples::UpdateObjectMetadata;
 
 pubsub::Publisher GetPublisher() {
@@ -42,6 +51,13 @@ pubsub::Publisher GetPublisher() {
   return publisher;
 }
 
+// Keep the dispatcher across requests, so prefixes rediscovered by other
+// requests handled by this instance are not scheduled twice.
+PrefixDispatcher& GetDispatcher() {
+  static auto dispatcher = PrefixDispatcher(GetPublisher());
+  return dispatcher;
+}
+
 spanner::Client GetSpannerClient() {
   static auto const client = [&] {
     auto database = spanner::Database(GetEnv("GOOGLE_CLOUD_PROJECT"),
@@ -64,6 +80,23 @@ nlohmann::json LogFormat(std::string const& sev, std::string const& msg) {
   return nlohmann::json{{"severity", sev}, {"message", msg}}.dump();
 }
 
+void LogCheckpoint(std::string const& bucket, std::string const& prefix,
+                   std::string const& position, SplitPolicy const& policy) {
+  std::cout << nlohmann::json{
+                   {"severity", "info"},
+                   {"message", "listing checkpoint"},
+                   {"bucket", bucket},
+                   {"prefix", prefix},
+                   {"position", position},
+                   {"entries", policy.entries()},
+                   {"progress", policy.progress()},
+                   {"entriesPerSecond", policy.rate()},
+                   {"estimatedRemainingSeconds",
+                    policy.estimated_remaining().count()},
+               }.dump()
+            << "\n";
+}
+
 gcf::HttpResponse LogError(std::string const& msg) {
   std::cerr << LogFormat("error", msg) << "\n";
   return gcf::HttpResponse{}
@@ -75,7 +108,8 @@ gcf::HttpResponse LogError(std::string const& msg) {
 
 gcf::HttpResponse IndexGcsPrefix(gcf::HttpRequest request) {  // NOLINT
   // This example assumes the push subscription is set for 10 minute deadline.
-  // We allow ourselves up to 5 minutes processing this request.
+  // We allow ourselves up to 5 minutes processing this request, but large
+  // prefixes are split much earlier, see `SplitPolicy`.
   auto const deadline =
       std::chrono::steady_clock::now() + std::chrono::minutes(5);
 
@@ -96,64 +130,101 @@ gcf::HttpResponse IndexGcsPrefix(gcf::HttpRequest request) {  // NOLINT
     return LogError("missing 'bucket' attribute in Pub/Sub message");
   }
   auto const bucket = attributes.value("bucket", "");
-  auto const prefix = [&attributes]() {
-    if (!attributes.contains("prefix")) return gcs::Prefix();
-    return gcs::Prefix(attributes.value("prefix", ""));
-  }();
-  auto const start = [&attributes]() {
-    if (!attributes.contains("start")) return gcs::StartOffset();
-    return gcs::StartOffset(attributes.value("start", ""));
+  // The message contains either a single prefix (and maybe a range within
+  // that prefix) in its attributes, or a list of prefixes created by
+  // `PrefixDispatcher`.
+  auto const prefixes = [&attributes, &message]() {
+    std::vector<gcs::Prefix> prefixes;
+    if (attributes.contains("prefix")) {
+      prefixes.emplace_back(attributes.value("prefix", ""));
+    } else if (message.value("data", "").empty()) {
+      prefixes.emplace_back();
+    } else {
+      using cppcodec::base64_rfc4648;
+      auto const data = base64_rfc4648::decode<std::string>(
+          message["data"].get_ref<std::string const&>());
+      for (auto& p : ParsePrefixList(data)) prefixes.emplace_back(p);
+    }
+    return prefixes;
   }();
+  auto start = attributes.value("start", "");
+  auto end = attributes.value("end", "");
 
   auto client = gcs::Client::CreateDefaultClient().value();
   auto publisher = GetPublisher();
+  auto& dispatcher = GetDispatcher();
 
   int mutation_count = 0;
   std::vector<google::cloud::future<google::cloud::Status>> pending;
-  for (auto const& entry : client.ListObjectsAndPrefixes(bucket, prefix, start,
-                                                         gcs::Delimiter("/"))) {
-    ThrowIfNotOkay("listing bucket " + bucket, entry.status());
-    if (std::chrono::steady_clock::now() >= deadline) {
-      struct SplitPoint {
-        std::string operator()(std::string const& s) { return s; }
-        std::string operator()(gcs::ObjectMetadata const& o) {
+  auto index_prefix = [&](gcs::Prefix const& prefix) {
+    auto const prefix_name =
+        prefix.has_value() ? prefix.value() : std::string{};
+    SplitPolicy policy(prefix_name, start, end, deadline);
+    auto const start_offset =
+        start.empty() ? gcs::StartOffset() : gcs::StartOffset(start);
+    auto const end_offset =
+        end.empty() ? gcs::EndOffset() : gcs::EndOffset(end);
+    for (auto const& entry : client.ListObjectsAndPrefixes(
+             bucket, prefix, start_offset, end_offset, gcs::Delimiter("/"))) {
+      ThrowIfNotOkay("listing bucket " + bucket, entry.status());
+      struct EntryName {
+        std::string const& operator()(std::string const& s) { return s; }
+        std::string const& operator()(gcs::ObjectMetadata const& o) {
           return o.name();
         }
       };
-      std::string start = absl::visit(SplitPoint{}, *entry);
-      auto builder = pubsub::MessageBuilder{}
-                         .InsertAttribute("bucket", bucket)
-                         .InsertAttribute("start", std::move(start));
-      if (prefix.has_value()) {
-        builder.InsertAttribute("prefix", prefix.value());
+      auto const& name = absl::visit(EntryName{}, *entry);
+      // Another worker took over the rest of the range.
+      if (policy.Done(name)) break;
+      auto decision = policy.OnEntry(name);
+      if (decision.checkpoint) {
+        LogCheckpoint(bucket, prefix_name, name, policy);
+      }
+      for (auto const& range : decision.handoff) {
+        pending.push_back(
+            publisher
+                .Publish(MakeListingRangeMessage(bucket, prefix_name, range))
+                .then([](auto f) { return f.get().status(); }));
+      }
+      if (decision.stop) return false;
+
+      if (absl::holds_alternative<std::string>(*entry)) {
+        auto const& p = absl::get<std::string>(*entry);
+        // Do not reschedule the same prefix we are processing.
+        if (prefix.has_value() && prefix.value() == p) continue;
+        pending.push_back(dispatcher.Schedule(bucket, p));
+      } else {
+        auto const& object = absl::get<gcs::ObjectMetadata>(*entry);
+        auto update = UpdateObjectMetadata(object);
+        GetSpannerClient()
+            .Commit([m = std::move(update)](auto) {
+              return spanner::Mutations{m};
+            })
+            .value();
+        ++mutation_count;
       }
-      pending.push_back(
-          publisher.Publish(std::move(builder).Build()).then([](auto f) {
-            return f.get().status();
-          }));
-      break;
     }
+    return true;
+  };
 
-    if (absl::holds_alternative<std::string>(*entry)) {
-      auto const& p = absl::get<std::string>(*entry);
-      // Do not reschedule the same prefix we are processing.
-      if (prefix.has_value() && prefix.value() == p) continue;
-      pending.push_back(publisher
-                            .Publish(pubsub::MessageBuilder{}
-                                         .InsertAttribute("bucket", bucket)
-                                         .InsertAttribute("prefix", p)
-                                         .Build())
-                            .then([](auto f) { return f.get().status(); }));
-    } else {
-      auto const& object = absl::get<gcs::ObjectMetadata>(*entry);
-      auto update = UpdateObjectMetadata(object);
-      GetSpannerClient()
-          .Commit(
-              [m = std::move(update)](auto) { return spanner::Mutations{m}; })
-          .value();
-      ++mutation_count;
+  for (auto p = prefixes.begin(); p != prefixes.end(); ++p) {
+    if (index_prefix(*p)) {
+      start.clear();
+      end.clear();
+      continue;
+    }
+    // Out of time, reschedule the prefixes we did not get to.
+    std::vector<std::string> remaining;
+    for (auto r = std::next(p); r != prefixes.end(); ++r) {
+      remaining.push_back(r->value());
     }
+    if (remaining.empty()) break;
+    pending.push_back(
+        publisher.Publish(MakePrefixListMessage(bucket, std::move(remaining)))
+            .then([](auto f) { return f.get().status(); }));
+    break;
   }
+  dispatcher.Flush();
   publisher.Flush();
   google::cloud::Status status;
   for (auto& p : pending) {
@@ -162,7 +233,9 @@ gcf::HttpResponse IndexGcsPrefix(gcf::HttpRequest request) {  // NOLINT
     status = std::move(publish_status);
   }
   ThrowIfNotOkay("publishing one or more messages", status);
-  std::cout << "DEBUG inserted " << mutation_count << " rows and sent "
-            << pending.size() << " messages\n";
+  auto const metrics = dispatcher.ResetMetrics();
+  std::cout << "DEBUG inserted " << mutation_count << " rows, scheduled "
+            << metrics.scheduled << " prefixes (" << metrics.duplicates
+            << " duplicates) in " << metrics.messages << " messages\n";
   return gcf::HttpResponse{};
 }
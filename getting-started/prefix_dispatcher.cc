@@ -0,0 +1,148 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "prefix_dispatcher.h"
+#include <nlohmann/json.hpp>
+
+namespace google::cloud::cpp_samples {
+
+namespace pubsub = ::google::cloud::pubsub;
+
+namespace {
+
+// GCS object names cannot contain newlines, so this key is unambiguous.
+std::string DedupKey(std::string const& bucket, std::string const& prefix) {
+  return bucket + '\n' + prefix;
+}
+
+}  // namespace
+
+PrefixDispatcher::PrefixDispatcher(pubsub::Publisher publisher,
+                                   PrefixDispatcherOptions options)
+    : publisher_(std::move(publisher)), options_(std::move(options)) {}
+
+future<Status> PrefixDispatcher::Schedule(std::string const& bucket,
+                                          std::string const& prefix) {
+  std::vector<PendingBatch> full;
+  future<Status> f;
+  {
+    std::unique_lock lk(mu_);
+    if (IsDuplicate(lk, DedupKey(bucket, prefix))) {
+      ++metrics_.duplicates;
+      return make_ready_future(Status{});
+    }
+    ++metrics_.scheduled;
+    auto& batch = pending_[bucket];
+    batch.prefixes.push_back(prefix);
+    batch.bytes += prefix.size();
+    batch.done.emplace_back();
+    f = batch.done.back().get_future();
+    if (batch.prefixes.size() >= options_.max_prefixes_per_message ||
+        batch.bytes >= options_.max_bytes_per_message) {
+      full.emplace_back(bucket, std::move(batch));
+      pending_.erase(bucket);
+    }
+  }
+  Publish(std::move(full));
+  return f;
+}
+
+void PrefixDispatcher::Flush() {
+  std::vector<PendingBatch> batches;
+  {
+    std::unique_lock lk(mu_);
+    for (auto& p : pending_) batches.emplace_back(p.first, std::move(p.second));
+    pending_.clear();
+  }
+  Publish(std::move(batches));
+}
+
+PrefixDispatcher::Metrics PrefixDispatcher::ResetMetrics() {
+  std::unique_lock lk(mu_);
+  Metrics m;
+  std::swap(m, metrics_);
+  return m;
+}
+
+bool PrefixDispatcher::IsDuplicate(std::unique_lock<std::mutex> const&,
+                                   std::string key) {
+  auto const now = std::chrono::steady_clock::now();
+  while (!expirations_.empty() &&
+         (expirations_.front().first <= now ||
+          expirations_.size() > options_.max_dedup_entries)) {
+    recent_.erase(expirations_.front().second);
+    expirations_.pop_front();
+  }
+  if (!recent_.insert(key).second) return true;
+  expirations_.emplace_back(now + options_.dedup_ttl, std::move(key));
+  return false;
+}
+
+void PrefixDispatcher::Publish(std::vector<PendingBatch> batches) {
+  {
+    std::unique_lock lk(mu_);
+    metrics_.messages += static_cast<std::int64_t>(batches.size());
+  }
+  for (auto& [bucket, batch] : batches) {
+    std::vector<std::string> keys;
+    keys.reserve(batch.prefixes.size());
+    for (auto const& p : batch.prefixes) keys.push_back(DedupKey(bucket, p));
+    publisher_.Publish(MakePrefixListMessage(bucket, std::move(batch.prefixes)))
+        .then([this, keys = std::move(keys),
+               done = std::move(batch.done)](auto f) mutable {
+          auto status = f.get().status();
+          if (!status.ok()) {
+            // The caller will retry these prefixes, e.g., when the message
+            // that discovered them is redelivered. They must not be treated
+            // as duplicates then.
+            std::unique_lock lk(mu_);
+            ++metrics_.errors;
+            for (auto const& k : keys) recent_.erase(k);
+          }
+          for (auto& p : done) p.set_value(status);
+        });
+  }
+}
+
+pubsub::Message MakePrefixListMessage(std::string const& bucket,
+                                      std::vector<std::string> prefixes) {
+  // A single prefix uses the same format as the messages created by hand in
+  // the README, which every version of the indexer understands.
+  if (prefixes.size() == 1) {
+    return pubsub::MessageBuilder{}
+        .InsertAttribute("bucket", bucket)
+        .InsertAttribute("prefix", std::move(prefixes.front()))
+        .Build();
+  }
+  return pubsub::MessageBuilder{}
+      .InsertAttribute("bucket", bucket)
+      .SetData(nlohmann::json(std::move(prefixes)).dump())
+      .Build();
+}
+
+pubsub::Message MakeListingRangeMessage(std::string const& bucket,
+                                        std::string const& prefix,
+                                        ListingRange const& range) {
+  auto builder = pubsub::MessageBuilder{}.InsertAttribute("bucket", bucket);
+  if (!prefix.empty()) builder.InsertAttribute("prefix", prefix);
+  if (!range.start.empty()) builder.InsertAttribute("start", range.start);
+  if (!range.end.empty()) builder.InsertAttribute("end", range.end);
+  return std::move(builder).Build();
+}
+
+std::vector<std::string> ParsePrefixList(std::string const& data) {
+  return nlohmann::json::parse(data).get<std::vector<std::string>>();
+}
+
+}  // namespace google::cloud::cpp_samples
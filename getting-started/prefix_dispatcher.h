@@ -0,0 +1,114 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_GETTING_STARTED_PREFIX_DISPATCHER_H
+#define CPP_SAMPLES_GETTING_STARTED_PREFIX_DISPATCHER_H
+
+#include "split_policy.h"
+#include <google/cloud/future.h>
+#include <google/cloud/pubsub/message.h>
+#include <google/cloud/pubsub/publisher.h>
+#include <google/cloud/status.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace google::cloud::cpp_samples {
+
+/// Controls how `PrefixDispatcher` batches and deduplicates prefixes.
+struct PrefixDispatcherOptions {
+  // Publish a message once it contains this many prefixes.
+  std::size_t max_prefixes_per_message = 100;
+  // Publish a message once its payload reaches this many bytes. Cloud Pub/Sub
+  // messages are limited to 10MiB, stay well below that.
+  std::size_t max_bytes_per_message = 256 * 1024;
+  // Prefixes scheduled within this period are not scheduled again.
+  std::chrono::seconds dedup_ttl = std::chrono::seconds(60);
+  // Bound the memory used to remember recently scheduled prefixes.
+  std::size_t max_dedup_entries = 1'000'000;
+};
+
+/**
+ * Publishes the prefixes discovered while listing a bucket.
+ *
+ * Buckets with wide hierarchies would otherwise produce one small Pub/Sub
+ * message per prefix. The dispatcher packs prefixes for the same bucket into
+ * a single message (see `MakePrefixListMessage()`), and drops prefixes that
+ * were already scheduled recently, e.g., when a prefix is rediscovered after
+ * a listing is split. If publishing a message fails its prefixes are
+ * forgotten, so they are not dropped when they are scheduled again.
+ */
+class PrefixDispatcher {
+ public:
+  explicit PrefixDispatcher(pubsub::Publisher publisher,
+                            PrefixDispatcherOptions options = {});
+
+  /// Schedule @p prefix in @p bucket, the future is satisfied once the
+  /// message containing the prefix is published.
+  future<Status> Schedule(std::string const& bucket, std::string const& prefix);
+
+  /// Publish any pending prefixes.
+  void Flush();
+
+  struct Metrics {
+    std::int64_t scheduled = 0;
+    std::int64_t duplicates = 0;
+    std::int64_t messages = 0;
+    std::int64_t errors = 0;
+  };
+  /// Return the metrics accumulated since the last call.
+  Metrics ResetMetrics();
+
+ private:
+  struct Batch {
+    std::vector<std::string> prefixes;
+    std::vector<promise<Status>> done;
+    std::size_t bytes = 0;
+  };
+  using PendingBatch = std::pair<std::string, Batch>;
+
+  bool IsDuplicate(std::unique_lock<std::mutex> const&, std::string key);
+  void Publish(std::vector<PendingBatch> batches);
+
+  pubsub::Publisher publisher_;
+  PrefixDispatcherOptions const options_;
+  std::mutex mu_;
+  std::map<std::string, Batch> pending_;
+  std::unordered_set<std::string> recent_;
+  std::deque<std::pair<std::chrono::steady_clock::time_point, std::string>>
+      expirations_;
+  Metrics metrics_;
+};
+
+/// Create a message asking the indexers to process all of @p prefixes.
+pubsub::Message MakePrefixListMessage(std::string const& bucket,
+                                      std::vector<std::string> prefixes);
+
+/// Create a message asking the indexers to list @p range within @p prefix.
+pubsub::Message MakeListingRangeMessage(std::string const& bucket,
+                                        std::string const& prefix,
+                                        ListingRange const& range);
+
+/// Parse the payload of a message created by `MakePrefixListMessage()`.
+std::vector<std::string> ParsePrefixList(std::string const& data);
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_GETTING_STARTED_PREFIX_DISPATCHER_H
@@ -0,0 +1,397 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "serve/object_index.h"
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
+
+namespace google::cloud::cpp_samples {
+namespace {
+
+// Queries over prefixes with fewer objects than this collect and sort the
+// matching rows. Larger prefixes scan the sorted arrays instead.
+auto constexpr kGatherLimit = 16 * 1024;
+
+// Compact the sorted arrays once 1 / kStaleRatio of their entries are stale.
+auto constexpr kStaleRatio = 2;
+
+// Fold the pending entries into the sorted arrays once there are this many.
+// Each update moves at most this many pending entries, and the O(objects) cost
+// of a fold is amortized over this many updates.
+auto constexpr kPendingLimit = std::size_t{4096};
+
+bool StartsWith(std::string_view s, std::string_view prefix) {
+  return s.substr(0, prefix.size()) == prefix;
+}
+
+}  // namespace
+
+struct ObjectIndex::Node {
+  // The child nodes, keyed by a name component including its trailing `/`.
+  std::map<std::string, std::unique_ptr<Node>, std::less<>> children;
+  // The objects in this node, keyed by the last component of their name.
+  std::map<std::string, std::uint32_t, std::less<>> objects;
+  // The number of objects in this node and all its descendants.
+  std::size_t count = 0;
+};
+
+namespace {
+
+using Node = ObjectIndex::Node;
+
+/// Visit the objects under @p node whose key starts with @p partial, in
+/// lexicographical order. Stops if @p f returns false.
+template <typename Functor>
+bool Visit(Node const& node, std::string_view partial, Functor& f) {
+  auto c = node.children.lower_bound(partial);
+  auto o = node.objects.lower_bound(partial);
+  for (;;) {
+    auto const has_child =
+        c != node.children.end() && StartsWith(c->first, partial);
+    auto const has_object =
+        o != node.objects.end() && StartsWith(o->first, partial);
+    if (!has_child && !has_object) return true;
+    if (has_object && (!has_child || o->first < c->first)) {
+      if (!f(o->second)) return false;
+      ++o;
+      continue;
+    }
+    if (!Visit(*c->second, {}, f)) return false;
+    ++c;
+  }
+}
+
+/// The number of objects under @p node whose key starts with @p partial,
+/// stopping once the count reaches @p limit.
+std::size_t CountUpTo(Node const& node, std::string_view partial,
+                      std::size_t limit) {
+  if (partial.empty()) return node.count;
+  std::size_t count = 0;
+  for (auto c = node.children.lower_bound(partial);
+       c != node.children.end() && StartsWith(c->first, partial) &&
+       count < limit;
+       ++c) {
+    count += c->second->count;
+  }
+  for (auto o = node.objects.lower_bound(partial);
+       o != node.objects.end() && StartsWith(o->first, partial) &&
+       count < limit;
+       ++o) {
+    ++count;
+  }
+  return count;
+}
+
+/// Find the node containing all the names that start with @p prefix, returns
+/// the node and the part of @p prefix after the node's path.
+std::pair<Node const*, std::string_view> FindPrefix(Node const* node,
+                                                    std::string_view prefix) {
+  for (auto pos = prefix.find('/'); node != nullptr && pos != prefix.npos;
+       pos = prefix.find('/')) {
+    auto i = node->children.find(prefix.substr(0, pos + 1));
+    node = i == node->children.end() ? nullptr : i->second.get();
+    prefix.remove_prefix(pos + 1);
+  }
+  return {node, prefix};
+}
+
+/// Visit the elements of two ranges sorted by @p comp, in order. Stops if
+/// @p f returns false.
+template <typename Iterator, typename Compare, typename Functor>
+void VisitMerged(Iterator a, Iterator a_end, Iterator b, Iterator b_end,
+                 Compare comp, Functor&& f) {
+  while (a != a_end || b != b_end) {
+    auto& i = b == b_end || (a != a_end && !comp(*b, *a)) ? a : b;
+    if (!f(*i)) return;
+    ++i;
+  }
+}
+
+}  // namespace
+
+ObjectIndex::ObjectIndex() = default;
+ObjectIndex::~ObjectIndex() = default;
+
+void ObjectIndex::Upsert(IndexedObject const& object) {
+  std::unique_lock<std::shared_mutex> lk(mu_);
+  auto [b, inserted] = bucket_ids_.emplace(
+      object.bucket, static_cast<std::uint32_t>(buckets_.size()));
+  if (inserted) {
+    buckets_.push_back(object.bucket);
+    roots_.push_back(std::make_unique<Node>());
+    ++nodes_;
+  }
+  auto const bucket = b->second;
+
+  std::vector<Node*> path{roots_[bucket].get()};
+  std::string_view name = object.name;
+  for (auto pos = name.find('/'); pos != name.npos; pos = name.find('/')) {
+    auto& child = path.back()->children[std::string(name.substr(0, pos + 1))];
+    if (!child) {
+      child = std::make_unique<Node>();
+      ++nodes_;
+    }
+    path.push_back(child.get());
+    name.remove_prefix(pos + 1);
+  }
+
+  auto& objects = path.back()->objects;
+  auto i = objects.find(name);
+  std::uint32_t row;
+  if (i != objects.end()) {
+    row = i->second;
+    if (generation_[row] > object.generation) return;
+    // The previous entries for this row become stale.
+    ++stale_;
+  } else {
+    row = NewRow();
+    objects.emplace(std::string(name), row);
+    for (auto* n : path) ++n->count;
+    ++objects_;
+    bucket_[row] = bucket;
+    name_[row] = object.name;
+  }
+  generation_[row] = object.generation;
+  size_[row] = object.size;
+  updated_[row] = object.updated;
+  ++version_[row];
+  Track(row);
+}
+
+void ObjectIndex::Remove(std::string const& bucket, std::string const& name,
+                         std::int64_t generation) {
+  std::unique_lock<std::shared_mutex> lk(mu_);
+  auto b = bucket_ids_.find(bucket);
+  if (b == bucket_ids_.end()) return;
+
+  // Each node in the path, and its location in the parent's children.
+  using Location = decltype(Node::children)::iterator;
+  std::vector<std::pair<Node*, Location>> path{
+      {roots_[b->second].get(), Location{}}};
+  std::string_view rest = name;
+  for (auto pos = rest.find('/'); pos != rest.npos; pos = rest.find('/')) {
+    auto& children = path.back().first->children;
+    auto i = children.find(rest.substr(0, pos + 1));
+    if (i == children.end()) return;
+    path.emplace_back(i->second.get(), i);
+    rest.remove_prefix(pos + 1);
+  }
+  auto& objects = path.back().first->objects;
+  auto i = objects.find(rest);
+  if (i == objects.end() || generation_[i->second] != generation) return;
+  FreeRow(i->second);
+  objects.erase(i);
+  --objects_;
+
+  // Update the counts and remove any empty nodes, except the bucket root.
+  for (auto n = path.size(); n-- != 0;) {
+    auto* node = path[n].first;
+    if (--node->count != 0 || n == 0) continue;
+    path[n - 1].first->children.erase(path[n].second);
+    --nodes_;
+  }
+}
+
+std::vector<IndexedObject> ObjectIndex::List(std::string const& bucket,
+                                             std::string_view prefix,
+                                             std::size_t limit) const {
+  std::shared_lock<std::shared_mutex> lk(mu_);
+  auto [node, partial] = FindPrefix(FindBucket(bucket), prefix);
+  std::vector<IndexedObject> result;
+  if (node == nullptr || limit == 0) return result;
+  auto f = [&](std::uint32_t row) {
+    result.push_back(MakeObject(row));
+    return result.size() < limit;
+  };
+  Visit(*node, partial, f);
+  return result;
+}
+
+std::vector<IndexedObject> ObjectIndex::Largest(std::string const& bucket,
+                                                std::string_view prefix,
+                                                std::size_t limit) const {
+  std::shared_lock<std::shared_mutex> lk(mu_);
+  std::vector<IndexedObject> result;
+  auto [node, partial] = FindPrefix(FindBucket(bucket), prefix);
+  if (node == nullptr || limit == 0) return result;
+
+  if (CountUpTo(*node, partial, kGatherLimit) < kGatherLimit) {
+    std::vector<std::uint32_t> rows;
+    auto f = [&rows](std::uint32_t row) {
+      rows.push_back(row);
+      return true;
+    };
+    Visit(*node, partial, f);
+    auto const n = (std::min)(limit, rows.size());
+    std::partial_sort(rows.begin(), rows.begin() + n, rows.end(),
+                      [this](auto a, auto b) { return size_[a] > size_[b]; });
+    for (auto i = rows.begin(); i != rows.begin() + n; ++i) {
+      result.push_back(MakeObject(*i));
+    }
+    return result;
+  }
+
+  auto const id = bucket_ids_.at(bucket);
+  VisitMerged(
+      by_size_.rbegin(), by_size_.rend(), pending_size_.rbegin(),
+      pending_size_.rend(),
+      [](Entry const& a, Entry const& b) { return a.value > b.value; },
+      [&](Entry const& e) {
+        if (Valid(e) && Matches(e.row, id, prefix)) {
+          result.push_back(MakeObject(e.row));
+        }
+        return result.size() < limit;
+      });
+  return result;
+}
+
+std::vector<IndexedObject> ObjectIndex::UpdatedSince(
+    std::string const& bucket, std::string_view prefix, std::int64_t since,
+    std::size_t limit) const {
+  std::shared_lock<std::shared_mutex> lk(mu_);
+  std::vector<IndexedObject> result;
+  auto [node, partial] = FindPrefix(FindBucket(bucket), prefix);
+  if (node == nullptr || limit == 0) return result;
+
+  if (CountUpTo(*node, partial, kGatherLimit) < kGatherLimit) {
+    std::vector<std::uint32_t> rows;
+    auto f = [&](std::uint32_t row) {
+      if (updated_[row] >= since) rows.push_back(row);
+      return true;
+    };
+    Visit(*node, partial, f);
+    auto const n = (std::min)(limit, rows.size());
+    std::partial_sort(
+        rows.begin(), rows.begin() + n, rows.end(),
+        [this](auto a, auto b) { return updated_[a] < updated_[b]; });
+    for (auto i = rows.begin(); i != rows.begin() + n; ++i) {
+      result.push_back(MakeObject(*i));
+    }
+    return result;
+  }
+
+  auto const id = bucket_ids_.at(bucket);
+  auto first = [since](std::vector<Entry> const& v) {
+    return std::lower_bound(
+        v.begin(), v.end(), since,
+        [](Entry const& e, std::int64_t v) { return e.value < v; });
+  };
+  VisitMerged(
+      first(by_updated_), by_updated_.end(), first(pending_updated_),
+      pending_updated_.end(),
+      [](Entry const& a, Entry const& b) { return a.value < b.value; },
+      [&](Entry const& e) {
+        if (Valid(e) && Matches(e.row, id, prefix)) {
+          result.push_back(MakeObject(e.row));
+        }
+        return result.size() < limit;
+      });
+  return result;
+}
+
+ObjectIndex::Stats ObjectIndex::stats() const {
+  std::shared_lock<std::shared_mutex> lk(mu_);
+  return Stats{objects_, buckets_.size(), nodes_, stale_};
+}
+
+bool ObjectIndex::Valid(Entry const& e) const {
+  return live_[e.row] && version_[e.row] == e.version;
+}
+
+IndexedObject ObjectIndex::MakeObject(std::uint32_t row) const {
+  return IndexedObject{buckets_[bucket_[row]], name_[row], generation_[row],
+                       size_[row], updated_[row]};
+}
+
+std::uint32_t ObjectIndex::NewRow() {
+  if (!free_rows_.empty()) {
+    auto const row = free_rows_.back();
+    free_rows_.pop_back();
+    live_[row] = true;
+    return row;
+  }
+  auto const row = static_cast<std::uint32_t>(name_.size());
+  bucket_.push_back(0);
+  name_.emplace_back();
+  generation_.push_back(0);
+  size_.push_back(0);
+  updated_.push_back(0);
+  version_.push_back(0);
+  live_.push_back(true);
+  return row;
+}
+
+void ObjectIndex::FreeRow(std::uint32_t row) {
+  live_[row] = false;
+  ++version_[row];
+  name_[row].clear();
+  name_[row].shrink_to_fit();
+  free_rows_.push_back(row);
+  ++stale_;
+}
+
+void ObjectIndex::Track(std::uint32_t row) {
+  // The pending arrays are small, keeping them sorted is cheap and lets the
+  // queries merge them with the sorted arrays as they scan.
+  auto insert = [](std::vector<Entry>& pending, Entry e) {
+    auto i = std::upper_bound(
+        pending.begin(), pending.end(), e.value,
+        [](std::int64_t v, Entry const& e) { return v < e.value; });
+    pending.insert(i, e);
+  };
+  insert(pending_size_, Entry{size_[row], row, version_[row]});
+  insert(pending_updated_, Entry{updated_[row], row, version_[row]});
+  if (pending_size_.size() >= kPendingLimit) MergePending();
+}
+
+void ObjectIndex::MergePending() {
+  auto by_value = [](Entry const& a, Entry const& b) {
+    return a.value < b.value;
+  };
+  auto merge = [&](std::vector<Entry>& sorted, std::vector<Entry>& pending) {
+    auto const mid = static_cast<std::ptrdiff_t>(sorted.size());
+    sorted.insert(sorted.end(), pending.begin(), pending.end());
+    std::inplace_merge(sorted.begin(), sorted.begin() + mid, sorted.end(),
+                       by_value);
+    pending.clear();
+  };
+  merge(by_size_, pending_size_);
+  merge(by_updated_, pending_updated_);
+
+  if (stale_ * kStaleRatio < by_size_.size()) return;
+  auto stale = [this](Entry const& e) { return !Valid(e); };
+  by_size_.erase(std::remove_if(by_size_.begin(), by_size_.end(), stale),
+                 by_size_.end());
+  by_updated_.erase(
+      std::remove_if(by_updated_.begin(), by_updated_.end(), stale),
+      by_updated_.end());
+  stale_ = 0;
+}
+
+ObjectIndex::Node const* ObjectIndex::FindBucket(
+    std::string const& bucket) const {
+  auto i = bucket_ids_.find(bucket);
+  if (i == bucket_ids_.end()) return nullptr;
+  return roots_[i->second].get();
+}
+
+bool ObjectIndex::Matches(std::uint32_t row, std::uint32_t bucket,
+                          std::string_view prefix) const {
+  return bucket_[row] == bucket && StartsWith(name_[row], prefix);
+}
+
+}  // namespace google::cloud::cpp_samples
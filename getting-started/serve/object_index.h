@@ -0,0 +1,142 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_GETTING_STARTED_SERVE_OBJECT_INDEX_H
+#define CPP_SAMPLES_GETTING_STARTED_SERVE_OBJECT_INDEX_H
+
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace google::cloud::cpp_samples {
+
+/// The subset of the `gcs_objects` columns kept by `ObjectIndex`.
+struct IndexedObject {
+  std::string bucket;
+  std::string name;
+  std::int64_t generation = 0;
+  std::int64_t size = 0;
+  // Nanoseconds since the Unix epoch.
+  std::int64_t updated = 0;
+};
+
+/**
+ * An in-memory index of the live objects in one or more buckets.
+ *
+ * The rows are stored by column. Each bucket has a trie over the `/`
+ * separated components of the object names, which answers prefix queries, and
+ * the index keeps arrays of (size, row) and (updated, row) sorted by value for
+ * the "largest objects" and "updated since" queries.
+ *
+ * Updates insert into small sorted pending arrays, which the queries scan
+ * together with the sorted arrays, so queries never modify the index. The
+ * update that fills the pending arrays merges them into the sorted arrays.
+ * Rows that are modified or removed leave stale entries in the sorted arrays,
+ * which are detected using a per-row version and removed once they are a
+ * large fraction of the arrays.
+ *
+ * The class is thread-safe. Queries run concurrently, updates are serialized.
+ */
+class ObjectIndex {
+ public:
+  ObjectIndex();
+  ~ObjectIndex();
+
+  /// Insert or update an object. Ignored if the index already contains a
+  /// newer generation of the object.
+  void Upsert(IndexedObject const& object);
+
+  /// Remove an object, if @p generation is its current generation.
+  void Remove(std::string const& bucket, std::string const& name,
+              std::int64_t generation);
+
+  /// The objects with names starting with @p prefix, in lexicographical
+  /// order.
+  std::vector<IndexedObject> List(std::string const& bucket,
+                                  std::string_view prefix,
+                                  std::size_t limit) const;
+
+  /// The largest objects with names starting with @p prefix, largest first.
+  std::vector<IndexedObject> Largest(std::string const& bucket,
+                                     std::string_view prefix,
+                                     std::size_t limit) const;
+
+  /// The objects with names starting with @p prefix updated at or after
+  /// @p since, oldest first.
+  std::vector<IndexedObject> UpdatedSince(std::string const& bucket,
+                                          std::string_view prefix,
+                                          std::int64_t since,
+                                          std::size_t limit) const;
+
+  struct Stats {
+    std::size_t objects;
+    std::size_t buckets;
+    std::size_t nodes;
+    std::size_t stale_entries;
+  };
+  Stats stats() const;
+
+  // A node in the trie over object names, only used in the implementation.
+  struct Node;
+
+ private:
+  struct Entry {
+    std::int64_t value;
+    std::uint32_t row;
+    std::uint32_t version;
+  };
+
+  bool Valid(Entry const& e) const;
+  IndexedObject MakeObject(std::uint32_t row) const;
+  std::uint32_t NewRow();
+  void FreeRow(std::uint32_t row);
+  void Track(std::uint32_t row);
+  void MergePending();
+  Node const* FindBucket(std::string const& bucket) const;
+  bool Matches(std::uint32_t row, std::uint32_t bucket,
+               std::string_view prefix) const;
+
+  mutable std::shared_mutex mu_;
+
+  // The columns, indexed by row. Removed rows are reused.
+  std::vector<std::uint32_t> bucket_;
+  std::vector<std::string> name_;
+  std::vector<std::int64_t> generation_;
+  std::vector<std::int64_t> size_;
+  std::vector<std::int64_t> updated_;
+  std::vector<std::uint32_t> version_;
+  std::vector<bool> live_;
+  std::vector<std::uint32_t> free_rows_;
+  std::size_t objects_ = 0;
+
+  // Bucket names are interned, the rows store the bucket id.
+  std::unordered_map<std::string, std::uint32_t> bucket_ids_;
+  std::vector<std::string> buckets_;
+  std::vector<std::unique_ptr<Node>> roots_;
+  std::size_t nodes_ = 0;
+
+  std::vector<Entry> by_size_;
+  std::vector<Entry> by_updated_;
+  std::vector<Entry> pending_size_;
+  std::vector<Entry> pending_updated_;
+  std::size_t stale_ = 0;
+};
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_GETTING_STARTED_SERVE_OBJECT_INDEX_H
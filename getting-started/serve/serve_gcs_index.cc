@@ -0,0 +1,321 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Serve queries over the `gcs_objects` index from memory.
+//
+// The program loads the live objects from the `gcs_objects` table (if the
+// SPANNER_* environment variables are set), and then applies the same GCS
+// object change events delivered to `update_gcs_index`. Point an Eventarc
+// trigger, or a Pub/Sub push subscription for a bucket notification, at `/`
+// to keep it up to date.
+//
+// Queries:
+//   GET /list?bucket=B&prefix=P&limit=N
+//   GET /largest?bucket=B&prefix=P&limit=N
+//   GET /updated?bucket=B&prefix=P&since=RFC3339&limit=N
+//   GET /stats
+
+#include "serve/object_index.h"
+#include "update/event_converter.h"
+#include "update/gcs_objects_schema.h"
+#include <absl/time/time.h>
+#include <cppcodec/base64_rfc4648.hpp>
+#include <google/cloud/functions/framework.h>
+#include <google/cloud/spanner/client.h>
+#include <nlohmann/json.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+
+namespace {
+
+namespace gcf = ::google::cloud::functions;
+namespace spanner = ::google::cloud::spanner;
+using google::cloud::cpp_samples::IndexedObject;
+using google::cloud::cpp_samples::kObjectColumns;
+using google::cloud::cpp_samples::ObjectColumn;
+using google::cloud::cpp_samples::ObjectIndex;
+using google::cloud::cpp_samples::ParseRfc3339;
+
+auto constexpr kDefaultLimit = 100;
+auto constexpr kMaxLimit = 10'000;
+
+// The event payloads use the same field names as the `gcs_objects` columns.
+std::string Field(ObjectColumn c) {
+  return std::string(kObjectColumns[static_cast<std::size_t>(c)].name);
+}
+
+std::int64_t ToNanos(spanner::Timestamp const& ts) {
+  return absl::ToUnixNanos(ts.get<absl::Time>().value());
+}
+
+std::int64_t ToInt64(nlohmann::json const& v) {
+  if (v.is_string()) return std::stoll(v.get<std::string>());
+  if (v.is_number()) return v.get<std::int64_t>();
+  return 0;
+}
+
+std::int64_t ToNanos(nlohmann::json const& v) {
+  if (!v.is_string()) return 0;
+  auto ts = ParseRfc3339(v.get<std::string>());
+  return ts ? ToNanos(*ts) : 0;
+}
+
+void ApplyEvent(ObjectIndex& index, std::string const& type,
+                nlohmann::json const& data) {
+  auto const bucket = data.value(Field(ObjectColumn::kBucket), "");
+  auto const name = data.value(Field(ObjectColumn::kName), "");
+  auto const generation =
+      ToInt64(data.value(Field(ObjectColumn::kGeneration), nlohmann::json{}));
+  if (bucket.empty() || name.empty()) {
+    throw std::runtime_error("missing bucket or name in event payload");
+  }
+  // Archived objects are no longer the live version of the object.
+  if (type == "google.cloud.storage.object.v1.deleted" ||
+      type == "google.cloud.storage.object.v1.archived") {
+    index.Remove(bucket, name, generation);
+    return;
+  }
+  index.Upsert(IndexedObject{
+      bucket, name, generation,
+      ToInt64(data.value(Field(ObjectColumn::kSize), nlohmann::json{})),
+      ToNanos(data.value(Field(ObjectColumn::kUpdated), nlohmann::json{}))});
+}
+
+// Map the `eventType` attribute of a Cloud Storage Pub/Sub notification to
+// the equivalent CloudEvents type, empty for types that do not change the
+// index.
+std::string NotificationEventType(std::string const& event_type) {
+  if (event_type == "OBJECT_FINALIZE") {
+    return "google.cloud.storage.object.v1.finalized";
+  }
+  if (event_type == "OBJECT_METADATA_UPDATE") {
+    return "google.cloud.storage.object.v1.metadataUpdated";
+  }
+  if (event_type == "OBJECT_DELETE") {
+    return "google.cloud.storage.object.v1.deleted";
+  }
+  if (event_type == "OBJECT_ARCHIVE") {
+    return "google.cloud.storage.object.v1.archived";
+  }
+  return {};
+}
+
+// Apply a Cloud Storage notification delivered by a Pub/Sub push
+// subscription. With the `JSON_API_V1` payload format the message data is the
+// object resource, with the `NONE` format only the attributes identify the
+// object.
+void ApplyNotification(ObjectIndex& index, nlohmann::json const& message) {
+  auto const attributes =
+      message.value("attributes", nlohmann::json::object());
+  auto const type = NotificationEventType(attributes.value("eventType", ""));
+  // Acknowledge other notifications, Pub/Sub would redeliver them otherwise.
+  if (type.empty()) return;
+  auto const data = message.value("data", "");
+  if (!data.empty()) {
+    using cppcodec::base64_rfc4648;
+    ApplyEvent(
+        index, type,
+        nlohmann::json::parse(base64_rfc4648::decode<std::string>(data)));
+    return;
+  }
+  ApplyEvent(index, type,
+             {{Field(ObjectColumn::kBucket), attributes.value("bucketId", "")},
+              {Field(ObjectColumn::kName), attributes.value("objectId", "")},
+              {Field(ObjectColumn::kGeneration),
+               attributes.value("objectGeneration", "")}});
+}
+
+void LoadFromSpanner(ObjectIndex& index) {
+  auto env = [](char const* name) {
+    auto const* v = std::getenv(name);
+    return v == nullptr ? std::string{} : std::string{v};
+  };
+  auto const project = env("GOOGLE_CLOUD_PROJECT");
+  auto const instance = env("SPANNER_INSTANCE");
+  auto const database = env("SPANNER_DATABASE");
+  if (project.empty() || instance.empty() || database.empty()) return;
+
+  auto client = spanner::Client(spanner::MakeConnection(
+      spanner::Database(project, instance, database)));
+  auto rows = client.ExecuteQuery(spanner::SqlStatement(
+      "SELECT bucket, name, generation, size, updated"
+      " FROM gcs_objects WHERE timeDeleted IS NULL"));
+  using RowType =
+      std::tuple<std::string, std::string, std::int64_t,
+                 absl::optional<std::int64_t>,
+                 absl::optional<spanner::Timestamp>>;
+  std::int64_t count = 0;
+  for (auto& row : spanner::StreamOf<RowType>(rows)) {
+    if (!row) throw std::runtime_error(row.status().message());
+    auto& [bucket, name, generation, size, updated] = *row;
+    index.Upsert(IndexedObject{std::move(bucket), std::move(name), generation,
+                               size.value_or(0),
+                               updated ? ToNanos(*updated) : 0});
+    ++count;
+  }
+  std::cout << "loaded " << count << " objects from " << database << "\n";
+}
+
+std::string Decode(std::string_view s) {
+  std::string out;
+  for (std::size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '+') {
+      out.push_back(' ');
+    } else if (s[i] == '%' && i + 2 < s.size()) {
+      out.push_back(static_cast<char>(
+          std::stoi(std::string(s.substr(i + 1, 2)), nullptr, 16)));
+      i += 2;
+    } else {
+      out.push_back(s[i]);
+    }
+  }
+  return out;
+}
+
+std::map<std::string, std::string> ParseQuery(std::string_view query) {
+  std::map<std::string, std::string> params;
+  while (!query.empty()) {
+    auto const amp = query.find('&');
+    auto const item = query.substr(0, amp);
+    auto const eq = item.find('=');
+    params[Decode(item.substr(0, eq))] =
+        eq == item.npos ? std::string{} : Decode(item.substr(eq + 1));
+    if (amp == query.npos) break;
+    query.remove_prefix(amp + 1);
+  }
+  return params;
+}
+
+gcf::HttpResponse JsonResponse(int code, nlohmann::json const& body) {
+  return gcf::HttpResponse{}
+      .set_result(code)
+      .set_header("content-type", "application/json")
+      .set_payload(body.dump());
+}
+
+nlohmann::json ToJson(std::vector<IndexedObject> const& objects) {
+  auto result = nlohmann::json::array();
+  for (auto const& o : objects) {
+    result.push_back({
+        {Field(ObjectColumn::kBucket), o.bucket},
+        {Field(ObjectColumn::kName), o.name},
+        {Field(ObjectColumn::kGeneration), std::to_string(o.generation)},
+        {Field(ObjectColumn::kSize), std::to_string(o.size)},
+        {Field(ObjectColumn::kUpdated),
+         absl::FormatTime(absl::RFC3339_full, absl::FromUnixNanos(o.updated),
+                          absl::UTCTimeZone())},
+    });
+  }
+  return result;
+}
+
+gcf::HttpResponse Query(ObjectIndex const& index, std::string_view path,
+                        std::map<std::string, std::string> const& params) {
+  auto param = [&params](char const* name) {
+    auto i = params.find(name);
+    return i == params.end() ? std::string{} : i->second;
+  };
+  if (path == "/stats") {
+    auto const s = index.stats();
+    return JsonResponse(gcf::HttpResponse::kOkay,
+                        {{"objects", s.objects},
+                         {"buckets", s.buckets},
+                         {"nodes", s.nodes},
+                         {"staleEntries", s.stale_entries}});
+  }
+
+  auto const bucket = param("bucket");
+  auto const prefix = param("prefix");
+  auto const l = param("limit");
+  auto const limit = static_cast<std::size_t>(
+      (std::clamp)(l.empty() ? kDefaultLimit : std::stoi(l), 0, kMaxLimit));
+  auto const start = std::chrono::steady_clock::now();
+  std::vector<IndexedObject> objects;
+  if (path == "/list") {
+    objects = index.List(bucket, prefix, limit);
+  } else if (path == "/largest") {
+    objects = index.Largest(bucket, prefix, limit);
+  } else if (path == "/updated") {
+    auto since = ParseRfc3339(param("since"));
+    if (!since) {
+      return JsonResponse(gcf::HttpResponse::kBadRequest,
+                          {{"error", "invalid or missing 'since'"}});
+    }
+    objects = index.UpdatedSince(bucket, prefix, ToNanos(*since), limit);
+  } else {
+    return JsonResponse(gcf::HttpResponse::kNotFound,
+                        {{"error", "unknown query"}});
+  }
+  auto const elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+  return JsonResponse(gcf::HttpResponse::kOkay,
+                      {{"objects", ToJson(objects)},
+                       {"elapsedMicroseconds", elapsed.count()}});
+}
+
+gcf::HttpResponse HandleEvent(ObjectIndex& index, gcf::HttpRequest const& r) {
+  auto header = [&r](char const* name) {
+    auto i = r.headers().find(name);
+    return i == r.headers().end() ? std::string{} : i->second;
+  };
+  // Events arrive in either binary mode, with the attributes in `ce-*`
+  // headers, or structured mode with the attributes in the payload. Pub/Sub
+  // push subscriptions wrap the notification in a `message` envelope.
+  auto const payload = nlohmann::json::parse(r.payload());
+  if (header("ce-type").empty() && payload.contains("message")) {
+    ApplyNotification(index, payload["message"]);
+  } else if (header("content-type").rfind("application/cloudevents+json", 0) ==
+             0) {
+    ApplyEvent(index, payload.value("type", ""),
+               payload.value("data", nlohmann::json::object()));
+  } else {
+    ApplyEvent(index, header("ce-type"), payload);
+  }
+  return gcf::HttpResponse{}.set_result(gcf::HttpResponse::kOkay);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) try {
+  auto index = std::make_shared<ObjectIndex>();
+  LoadFromSpanner(*index);
+  return gcf::Run(argc, argv, [index](gcf::HttpRequest request) {
+    try {
+      auto const& target = request.target();
+      auto const q = target.find('?');
+      auto const path = std::string_view(target).substr(0, q);
+      if (request.verb() == "POST") return HandleEvent(*index, request);
+      return Query(*index, path,
+                   q == target.npos
+                       ? std::map<std::string, std::string>{}
+                       : ParseQuery(std::string_view(target).substr(q + 1)));
+    } catch (std::exception const& ex) {
+      std::cerr << nlohmann::json{{"severity", "error"},
+                                  {"message", ex.what()}}
+                       .dump()
+                << "\n";
+      return JsonResponse(gcf::HttpResponse::kBadRequest,
+                          {{"error", ex.what()}});
+    }
+  });
+} catch (std::exception const& ex) {
+  std::cerr << "Standard C++ exception thrown: " << ex.what() << "\n";
+  return 1;
+}
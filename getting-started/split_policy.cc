@@ -0,0 +1,165 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "split_policy.h"
+#include <algorithm>
+#include <cmath>
+
+namespace google::cloud::cpp_samples {
+namespace {
+
+// Positions are computed from the printable ASCII characters following the
+// common prefix of the range. Split points are always printable ASCII, and
+// therefore valid object names.
+auto constexpr kFirstChar = 0x20;
+auto constexpr kLastChar = 0x7e;
+auto constexpr kBase = kLastChar - kFirstChar + 1;
+auto constexpr kDigits = 6;
+
+/// The smallest name that is not in @p prefix, empty if there is none.
+std::string PrefixUpperBound(std::string prefix) {
+  while (!prefix.empty()) {
+    auto& c = prefix.back();
+    if (static_cast<unsigned char>(c) < kLastChar) {
+      ++c;
+      return prefix;
+    }
+    prefix.pop_back();
+  }
+  return prefix;
+}
+
+std::size_t CommonPrefixLength(std::string const& a, std::string const& b) {
+  auto const n = (std::min)(a.size(), b.size());
+  return std::mismatch(a.begin(), a.begin() + n, b.begin()).first - a.begin();
+}
+
+}  // namespace
+
+SplitPolicy::SplitPolicy(std::string const& prefix, std::string start,
+                         std::string end, Clock::time_point deadline,
+                         SplitPolicyOptions options, Clock::time_point now)
+    : options_(std::move(options)),
+      lower_((std::max)(prefix, start)),
+      end_(std::move(end)),
+      upper_(end_.empty() ? PrefixUpperBound(prefix) : end_),
+      common_(upper_.empty() ? 0 : CommonPrefixLength(lower_, upper_)),
+      deadline_(deadline),
+      started_(now == Clock::time_point{} ? Clock::now() : now),
+      next_check_(started_),
+      next_checkpoint_(started_ + options_.checkpoint_interval) {
+  lower_position_ = Position(lower_);
+  upper_position_ = upper_.empty() ? 1.0 : Position(upper_);
+  position_ = lower_position_;
+}
+
+SplitPolicy::Decision SplitPolicy::OnEntry(std::string const& name,
+                                           Clock::time_point now) {
+  if (now == Clock::time_point{}) now = Clock::now();
+  ++entries_;
+  if (now < next_check_) return {};
+  next_check_ = now + options_.check_interval;
+
+  Decision decision;
+  position_ = (std::clamp)(Position(name), lower_position_, upper_position_);
+  auto const width = upper_position_ - lower_position_;
+  progress_ = width <= 0 ? 0 : (position_ - lower_position_) / width;
+  if (now >= next_checkpoint_) {
+    decision.checkpoint = true;
+    next_checkpoint_ = now + options_.checkpoint_interval;
+  }
+
+  if (now >= deadline_) {
+    decision.stop = true;
+    decision.handoff.push_back(ListingRange{name, end_});
+    return decision;
+  }
+  auto const elapsed = now - started_;
+  if (elapsed < options_.warmup) return decision;
+
+  using seconds = std::chrono::duration<double>;
+  auto const velocity = (position_ - lower_position_) /
+                        std::chrono::duration_cast<seconds>(elapsed).count();
+  if (velocity <= 0) return decision;
+  remaining_seconds_ = (upper_position_ - position_) / velocity;
+
+  auto const target =
+      std::chrono::duration_cast<seconds>(options_.target_duration).count();
+  if (remaining_seconds_ <= target || splits_ >= options_.max_splits) {
+    return decision;
+  }
+  auto const count = (std::min)(
+      static_cast<std::size_t>(std::ceil(remaining_seconds_ / target)),
+      options_.max_splits - splits_ + 1);
+
+  std::vector<std::string> points;
+  for (std::size_t k = 1; k < count; ++k) {
+    auto p = Name(position_ + (upper_position_ - position_) * k / count);
+    if (p <= name || (!upper_.empty() && p >= upper_)) continue;
+    if (!points.empty() && p <= points.back()) continue;
+    points.push_back(std::move(p));
+  }
+  if (points.empty()) return decision;
+
+  for (std::size_t k = 0; k != points.size(); ++k) {
+    decision.handoff.push_back(ListingRange{
+        points[k], k + 1 == points.size() ? end_ : points[k + 1]});
+  }
+  splits_ += points.size();
+  end_ = points.front();
+  upper_ = end_;
+  upper_position_ = Position(upper_);
+  remaining_seconds_ /= static_cast<double>(count);
+  return decision;
+}
+
+double SplitPolicy::rate() const {
+  using seconds = std::chrono::duration<double>;
+  auto const elapsed = std::chrono::duration_cast<seconds>(
+      (std::max)(Clock::now() - started_, Clock::duration(1)));
+  return static_cast<double>(entries_) / elapsed.count();
+}
+
+std::chrono::seconds SplitPolicy::estimated_remaining() const {
+  return std::chrono::seconds(static_cast<std::int64_t>(remaining_seconds_));
+}
+
+double SplitPolicy::Position(std::string const& name) const {
+  double position = 0;
+  double scale = 1.0 / kBase;
+  for (std::size_t i = common_; i != common_ + kDigits; ++i) {
+    auto const c = i < name.size() ? static_cast<unsigned char>(name[i]) : 0;
+    auto const digit = (std::clamp)(static_cast<int>(c), kFirstChar, kLastChar);
+    position += (digit - kFirstChar) * scale;
+    scale /= kBase;
+  }
+  return position;
+}
+
+std::string SplitPolicy::Name(double position) const {
+  auto name = lower_.substr(0, common_);
+  for (int i = 0; i != kDigits; ++i) {
+    position *= kBase;
+    auto const digit = (std::clamp)(static_cast<int>(position), 0, kBase - 1);
+    position -= digit;
+    name.push_back(static_cast<char>(kFirstChar + digit));
+  }
+  // Trailing spaces do not change the order relative to other split points.
+  while (name.size() > common_ + 1 && name.back() == kFirstChar) {
+    name.pop_back();
+  }
+  return name;
+}
+
+}  // namespace google::cloud::cpp_samples
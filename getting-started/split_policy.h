@@ -0,0 +1,117 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_GETTING_STARTED_SPLIT_POLICY_H
+#define CPP_SAMPLES_GETTING_STARTED_SPLIT_POLICY_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace google::cloud::cpp_samples {
+
+/// Controls when `SplitPolicy` hands off part of a listing to other workers.
+struct SplitPolicyOptions {
+  // Measure the listing rate for this long before estimating the remaining
+  // work.
+  std::chrono::milliseconds warmup = std::chrono::seconds(5);
+  // How often to re-evaluate the estimate.
+  std::chrono::milliseconds check_interval = std::chrono::seconds(1);
+  // Split the remaining range if listing it is expected to take longer than
+  // this.
+  std::chrono::milliseconds target_duration = std::chrono::seconds(30);
+  // The maximum number of ranges handed off by a single worker.
+  std::size_t max_splits = 16;
+  // How often to record a progress checkpoint.
+  std::chrono::milliseconds checkpoint_interval = std::chrono::seconds(30);
+};
+
+/// A range of names, [start, end), to be listed by another worker. An empty
+/// `end` means the range extends to the end of the prefix.
+struct ListingRange {
+  std::string start;
+  std::string end;
+};
+
+/**
+ * Decides when and where to split the listing of a large prefix.
+ *
+ * GCS lists objects in lexicographical order, the policy maps each name to a
+ * position in [0, 1] within the range being listed, and estimates the time
+ * left from the rate at which the listing advances through that interval.
+ * When the remaining range would take longer than `target_duration`, the
+ * policy splits it into several sub-ranges. The current worker keeps the
+ * first one, the others should be published as new work items.
+ */
+class SplitPolicy {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  /// Create a policy to list [@p start, @p end) within @p prefix. The listing
+  /// must stop, and hand off the rest of the range, at @p deadline.
+  SplitPolicy(std::string const& prefix, std::string start, std::string end,
+              Clock::time_point deadline, SplitPolicyOptions options = {},
+              Clock::time_point now = {});
+
+  struct Decision {
+    // Ranges to hand off to other workers, in ascending order.
+    std::vector<ListingRange> handoff;
+    // If true, the listing should stop at the current entry.
+    bool stop = false;
+    // If true, the caller should record a progress checkpoint.
+    bool checkpoint = false;
+  };
+  Decision OnEntry(std::string const& name, Clock::time_point now = {});
+
+  /// The end of the range listed by this worker, empty if unbounded.
+  std::string const& end() const { return end_; }
+  /// True if @p name is past the range listed by this worker.
+  bool Done(std::string const& name) const {
+    return !end_.empty() && name >= end_;
+  }
+
+  std::int64_t entries() const { return entries_; }
+  /// The fraction of the range kept by this worker already listed.
+  double progress() const { return progress_; }
+  /// The listing rate in entries per second.
+  double rate() const;
+  /// The estimated time left to list the range kept by this worker.
+  std::chrono::seconds estimated_remaining() const;
+
+ private:
+  double Position(std::string const& name) const;
+  std::string Name(double position) const;
+
+  SplitPolicyOptions const options_;
+  std::string const lower_;
+  std::string end_;
+  std::string upper_;
+  std::size_t common_ = 0;
+  Clock::time_point const deadline_;
+  Clock::time_point const started_;
+  Clock::time_point next_check_;
+  Clock::time_point next_checkpoint_;
+  std::int64_t entries_ = 0;
+  std::size_t splits_ = 0;
+  double lower_position_ = 0;
+  double upper_position_ = 1;
+  double position_ = 0;
+  double progress_ = 0;
+  double remaining_seconds_ = 0;
+};
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_GETTING_STARTED_SPLIT_POLICY_H
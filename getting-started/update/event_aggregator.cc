@@ -0,0 +1,108 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "event_aggregator.h"
+#include <algorithm>
+#include <exception>
+#include <vector>
+
+namespace google::cloud::cpp_samples {
+namespace {
+
+// GCS object names cannot contain newlines, so this separator is safe.
+auto constexpr kKeySeparator = '\n';
+
+// The primary key columns of `gcs_objects`, in order.
+char const* const kKeyColumns[] = {"bucket", "name", "generation"};
+
+std::string KeyFromValues(google::protobuf::ListValue const& values,
+                          std::vector<int> const& positions) {
+  std::string key;
+  for (auto p : positions) {
+    if (p < 0 || p >= values.values_size()) return {};
+    key += values.values(p).string_value();
+    key += kKeySeparator;
+  }
+  return key;
+}
+
+}  // namespace
+
+EventAggregator::EventAggregator(spanner::Client client,
+                                 EventAggregatorOptions options)
+    : client_(std::move(client)), options_(std::move(options)) {}
+
+Status EventAggregator::Apply(spanner::Mutation mutation) {
+  auto key = MutationKey(mutation);
+  std::unique_lock<std::mutex> lk(mu_);
+  auto const leader = !current_;
+  if (leader) current_ = std::make_shared<Batch>();
+  auto batch = current_;
+  auto loc = batch->index.end();
+  if (!key.empty()) loc = batch->index.find(key);
+  if (loc != batch->index.end()) {
+    // A later event for the same object replaces the earlier one.
+    batch->mutations[loc->second] = std::move(mutation);
+  } else {
+    if (!key.empty()) batch->index.emplace(key, batch->mutations.size());
+    batch->mutations.push_back(std::move(mutation));
+  }
+  if (batch->mutations.size() >= options_.max_rows) {
+    // Start a new batch for any new events, and wake up the leader.
+    current_.reset();
+    cv_.notify_all();
+  }
+  if (!leader) {
+    lk.unlock();
+    return batch->result.get();
+  }
+
+  cv_.wait_for(lk, options_.window, [&] { return current_ != batch; });
+  if (current_ == batch) current_.reset();
+  lk.unlock();
+
+  try {
+    auto status =
+        client_.Commit([&batch](auto) { return batch->mutations; }).status();
+    batch->done.set_value(status);
+    return status;
+  } catch (...) {
+    // The followers are blocked on this batch, they must see the error too.
+    batch->done.set_exception(std::current_exception());
+    throw;
+  }
+}
+
+std::string MutationKey(spanner::Mutation const& mutation) {
+  auto const proto = mutation.as_proto();
+  if (proto.has_insert_or_update()) {
+    auto const& write = proto.insert_or_update();
+    if (write.values_size() == 0) return {};
+    std::vector<int> positions;
+    for (auto const* name : kKeyColumns) {
+      auto const& columns = write.columns();
+      auto const f = std::find(columns.begin(), columns.end(), name);
+      positions.push_back(static_cast<int>(f - columns.begin()));
+    }
+    return KeyFromValues(write.values(0), positions);
+  }
+  if (proto.has_delete_()) {
+    auto const& keys = proto.delete_().key_set().keys();
+    if (keys.empty()) return {};
+    return KeyFromValues(keys.Get(0), {0, 1, 2});
+  }
+  return {};
+}
+
+}  // namespace google::cloud::cpp_samples
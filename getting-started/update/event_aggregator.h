@@ -0,0 +1,86 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_GETTING_STARTED_UPDATE_EVENT_AGGREGATOR_H
+#define CPP_SAMPLES_GETTING_STARTED_UPDATE_EVENT_AGGREGATOR_H
+
+#include <google/cloud/spanner/client.h>
+#include <google/cloud/spanner/mutations.h>
+#include <google/cloud/status.h>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace google::cloud::cpp_samples {
+
+/// Controls how `EventAggregator` groups events into commits.
+struct EventAggregatorOptions {
+  // Events arriving within this window of the first event in a batch share
+  // the same commit.
+  std::chrono::milliseconds window = std::chrono::milliseconds(50);
+  // Commit a batch early once it contains this many rows. Spanner recommends
+  // changing at most "a few hundred rows" at a time:
+  //   https://cloud.google.com/spanner/docs/bulk-loading
+  std::size_t max_rows = 512;
+};
+
+/**
+ * Coalesces concurrent index updates into multi-row Spanner commits.
+ *
+ * The functions framework may run several invocations of the function
+ * concurrently. Each invocation calls `Apply()`, which blocks until the
+ * commit containing its mutation completes. The first invocation in a batch
+ * waits for `window` (or until the batch is full) and then commits all the
+ * mutations received in the meantime.
+ *
+ * Within a batch, repeated events for the same (bucket, name, generation)
+ * collapse to the last one received. All the invocations sharing a commit
+ * receive its status, and only return success, acknowledging the event, if
+ * the commit succeeded. If the commit throws, the exception is rethrown in
+ * every invocation sharing it.
+ */
+class EventAggregator {
+ public:
+  explicit EventAggregator(spanner::Client client,
+                           EventAggregatorOptions options = {});
+
+  /// Add @p mutation to the current batch and wait until it is committed.
+  Status Apply(spanner::Mutation mutation);
+
+ private:
+  struct Batch {
+    spanner::Mutations mutations;
+    std::unordered_map<std::string, std::size_t> index;
+    std::promise<Status> done;
+    std::shared_future<Status> result = done.get_future().share();
+  };
+
+  spanner::Client client_;
+  EventAggregatorOptions const options_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::shared_ptr<Batch> current_;
+};
+
+/// The (bucket, name, generation) key modified by @p mutation, encoded as a
+/// string. Empty if the mutation does not modify a single `gcs_objects` row.
+std::string MutationKey(spanner::Mutation const& mutation);
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_GETTING_STARTED_UPDATE_EVENT_AGGREGATOR_H
@@ -0,0 +1,342 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "event_converter.h"
+#include "gcs_objects_schema.h"
+#include <absl/time/time.h>
+#include <nlohmann/json.hpp>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+namespace google::cloud::cpp_samples {
+namespace {
+
+namespace spanner = ::google::cloud::spanner;
+
+auto constexpr kNotFound = kObjectColumnCount;
+
+std::size_t FindColumn(std::string_view name) {
+  auto const c = FindObjectColumn(name);
+  return c ? Index(*c) : kNotFound;
+}
+
+std::int64_t ToInt64(std::string_view name, std::string_view value) {
+  std::int64_t v;
+  auto const* end = value.data() + value.size();
+  auto [ptr, ec] = std::from_chars(value.data(), end, v);
+  if (ec != std::errc{} || ptr != end) {
+    throw std::runtime_error("invalid integer p[" + std::string(name) +
+                             "]=" + std::string(value));
+  }
+  return v;
+}
+
+spanner::Timestamp ToTimestamp(std::string_view name, std::string_view value) {
+  if (auto ts = ParseRfc3339(value)) return *std::move(ts);
+  // Fallback to the (much slower) general purpose parser.
+  auto constexpr kParseSpec = "%Y-%m-%d%ET%H:%M:%E*S%Ez";
+  absl::Time t;
+  std::string err;
+  if (absl::ParseTime(kParseSpec, std::string(value), &t, &err)) {
+    return spanner::MakeTimestamp(t).value();
+  }
+  throw std::runtime_error("timestamp p[" + std::string(name) +
+                           "]=" + std::string(value) + ": " + err);
+}
+
+void AppendQuoted(std::string& out, std::string_view s) {
+  out.push_back('"');
+  for (auto c : s) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buf[8];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<int>(c));
+          out += buf;
+        } else {
+          out.push_back(c);
+        }
+    }
+  }
+  out.push_back('"');
+}
+
+/**
+ * Converts the SAX events for an object payload into column values.
+ *
+ * Fields in the top-level object are mapped to columns as they are parsed.
+ * Nested objects are only needed for `ColumnType::kJson` columns, their text is
+ * captured into a buffer. Any other nested values are skipped.
+ */
+class RowBuilder {
+ public:
+  using json = nlohmann::json;
+
+  explicit RowBuilder(ObjectRow& row) : row_(row) {}
+
+  // The nlohmann::json SAX interface.
+  bool null() {
+    if (capturing()) return Capture("null");
+    return Set([](ColumnType t) { return NullValue(t); });
+  }
+  bool boolean(bool v) {
+    if (capturing()) return Capture(v ? "true" : "false");
+    return Set([v](ColumnType) { return spanner::Value(v); });
+  }
+  bool number_integer(json::number_integer_t v) {
+    if (capturing()) return Capture(std::to_string(v));
+    return Set([v](ColumnType) { return spanner::Value(std::int64_t{v}); });
+  }
+  bool number_unsigned(json::number_unsigned_t v) {
+    if (capturing()) return Capture(std::to_string(v));
+    return Set([v](ColumnType) {
+      return spanner::Value(static_cast<std::int64_t>(v));
+    });
+  }
+  bool number_float(json::number_float_t, json::string_t const& s) {
+    if (capturing()) return Capture(s);
+    return true;
+  }
+  bool string(json::string_t& v) {
+    if (capturing()) {
+      Separator();
+      AppendQuoted(capture_, v);
+      return true;
+    }
+    auto const column = column_;
+    return Set([&](ColumnType t) {
+      auto const name = kObjectColumns[column].name;
+      switch (t) {
+        case ColumnType::kInt64:
+          return spanner::Value(ToInt64(name, v));
+        case ColumnType::kTimestamp:
+          return spanner::Value(ToTimestamp(name, v));
+        case ColumnType::kString:
+        case ColumnType::kJson:
+          break;
+        case ColumnType::kBool:
+          return spanner::Value(v == "true");
+      }
+      return spanner::Value(std::move(v));
+    });
+  }
+  bool binary(json::binary_t&) { return true; }
+  bool start_object(std::size_t) { return Start('{'); }
+  bool end_object() { return End('}'); }
+  bool start_array(std::size_t) { return Start('['); }
+  bool end_array() { return End(']'); }
+  bool key(json::string_t& k) {
+    if (capturing()) {
+      Separator();
+      AppendQuoted(capture_, k);
+      capture_.push_back(':');
+      after_key_ = true;
+      return true;
+    }
+    if (depth_ == 1) column_ = FindColumn(k);
+    return true;
+  }
+  bool parse_error(std::size_t position, std::string const& last_token,
+                   nlohmann::detail::exception const& ex) {
+    throw std::runtime_error("error parsing payload at " +
+                             std::to_string(position) + " near " +
+                             last_token + ": " + ex.what());
+  }
+
+ private:
+  bool capturing() const { return capture_depth_ != 0; }
+
+  // Set the value for the current column, if it is known.
+  template <typename Functor>
+  bool Set(Functor&& f) {
+    if (depth_ != 1 || column_ == kNotFound) return true;
+    auto const c = static_cast<ObjectColumn>(column_);
+    row_.Set(c, f(kObjectColumns[column_].type));
+    return true;
+  }
+
+  void Separator() {
+    if (after_key_) {
+      after_key_ = false;
+      return;
+    }
+    if (!first_) capture_.push_back(',');
+    first_ = false;
+  }
+
+  bool Capture(std::string_view token) {
+    Separator();
+    capture_ += token;
+    return true;
+  }
+
+  bool Start(char c) {
+    ++depth_;
+    if (capturing()) {
+      Capture(std::string_view(&c, 1));
+      first_ = true;
+      return true;
+    }
+    if (depth_ == 2 && column_ != kNotFound &&
+        kObjectColumns[column_].type == ColumnType::kJson) {
+      capture_depth_ = depth_;
+      capture_.assign(1, c);
+      first_ = true;
+      after_key_ = false;
+    }
+    return true;
+  }
+
+  bool End(char c) {
+    if (capturing()) {
+      capture_.push_back(c);
+      first_ = false;
+      if (depth_ == capture_depth_) {
+        capture_depth_ = 0;
+        row_.Set(static_cast<ObjectColumn>(column_),
+                 spanner::Value(std::move(capture_)));
+        capture_.clear();
+      }
+    }
+    --depth_;
+    return true;
+  }
+
+  ObjectRow& row_;
+  std::size_t column_ = kNotFound;
+  int depth_ = 0;
+  int capture_depth_ = 0;
+  std::string capture_;
+  bool first_ = true;
+  bool after_key_ = false;
+};
+
+// Parse @p payload into a per-thread row buffer, which is reused for every
+// event processed by the thread.
+ObjectRow& ParsePayload(std::string_view payload) {
+  thread_local ObjectRow row;
+  row.Reset();
+  RowBuilder builder(row);
+  nlohmann::json::sax_parse(payload.begin(), payload.end(), &builder);
+  return row;
+}
+
+bool ParseDigits(std::string_view s, std::size_t pos, std::size_t n, int& v) {
+  if (pos + n > s.size()) return false;
+  v = 0;
+  for (auto i = pos; i != pos + n; ++i) {
+    if (s[i] < '0' || s[i] > '9') return false;
+    v = v * 10 + (s[i] - '0');
+  }
+  return true;
+}
+
+int DaysInMonth(int y, int m) {
+  if (m == 2) return (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)) ? 29 : 28;
+  return (m == 4 || m == 6 || m == 9 || m == 11) ? 30 : 31;
+}
+
+// The number of days since 1970-01-01 for a date in the proleptic Gregorian
+// calendar, see http://howardhinnant.github.io/date_algorithms.html
+std::int64_t DaysFromCivil(std::int64_t y, int m, int d) {
+  y -= m <= 2;
+  auto const era = (y >= 0 ? y : y - 399) / 400;
+  auto const yoe = y - era * 400;
+  auto const doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  auto const doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+}  // namespace
+
+absl::optional<spanner::Timestamp> ParseRfc3339(std::string_view value) {
+  // The fixed part of the format is `YYYY-MM-DDTHH:MM:SS`.
+  int year, month, day, hour, minute, second;
+  if (!ParseDigits(value, 0, 4, year) || value.size() < 20 ||
+      value[4] != '-' || !ParseDigits(value, 5, 2, month) || value[7] != '-' ||
+      !ParseDigits(value, 8, 2, day) ||
+      (value[10] != 'T' && value[10] != 't') ||
+      !ParseDigits(value, 11, 2, hour) || value[13] != ':' ||
+      !ParseDigits(value, 14, 2, minute) || value[16] != ':' ||
+      !ParseDigits(value, 17, 2, second)) {
+    return absl::nullopt;
+  }
+  if (month < 1 || month > 12 || day < 1 || day > DaysInMonth(year, month) ||
+      hour > 23 || minute > 59 || second > 59) {
+    return absl::nullopt;
+  }
+
+  // An optional fraction, with up to nanosecond precision.
+  std::size_t pos = 19;
+  std::int64_t nanos = 0;
+  if (value[pos] == '.') {
+    auto scale = 100'000'000;
+    for (++pos; pos < value.size() && value[pos] >= '0' && value[pos] <= '9';
+         ++pos) {
+      nanos += (value[pos] - '0') * scale;
+      scale /= 10;
+    }
+    if (pos == 20 || pos > 29) return absl::nullopt;
+  }
+
+  // The timezone offset, either `Z` or `+HH:MM` / `-HH:MM`.
+  if (pos >= value.size()) return absl::nullopt;
+  std::int64_t offset = 0;
+  if (value[pos] == 'Z' || value[pos] == 'z') {
+    ++pos;
+  } else if (value[pos] == '+' || value[pos] == '-') {
+    int offset_hours, offset_minutes;
+    if (!ParseDigits(value, pos + 1, 2, offset_hours) ||
+        pos + 3 >= value.size() || value[pos + 3] != ':' ||
+        !ParseDigits(value, pos + 4, 2, offset_minutes) ||
+        offset_hours > 23 || offset_minutes > 59) {
+      return absl::nullopt;
+    }
+    offset = (offset_hours * 60 + offset_minutes) * 60;
+    if (value[pos] == '-') offset = -offset;
+    pos += 6;
+  } else {
+    return absl::nullopt;
+  }
+  if (pos != value.size()) return absl::nullopt;
+
+  auto const seconds = DaysFromCivil(year, month, day) * 86400 +
+                       hour * 3600 + minute * 60 + second - offset;
+  using std::chrono::nanoseconds;
+  auto const tp = std::chrono::time_point<std::chrono::system_clock,
+                                          nanoseconds>(
+      std::chrono::seconds(seconds) + nanoseconds(nanos));
+  auto ts = spanner::MakeTimestamp(tp);
+  if (!ts) return absl::nullopt;
+  return *std::move(ts);
+}
+
+spanner::Mutation UpdateObjectMetadata(std::string_view payload) {
+  return ParsePayload(payload).MakeUpsert();
+}
+
+spanner::Mutation DeleteObjectMetadata(std::string_view payload) {
+  return ParsePayload(payload).MakeDelete();
+}
+
+}  // namespace google::cloud::cpp_samples
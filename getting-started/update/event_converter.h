@@ -0,0 +1,44 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_GETTING_STARTED_UPDATE_EVENT_CONVERTER_H
+#define CPP_SAMPLES_GETTING_STARTED_UPDATE_EVENT_CONVERTER_H
+
+#include <absl/types/optional.h>
+#include <google/cloud/spanner/mutations.h>
+#include <google/cloud/spanner/timestamp.h>
+#include <string_view>
+
+namespace google::cloud::cpp_samples {
+
+/**
+ * Convert the payload of a GCS object event into a `gcs_objects` upsert.
+ *
+ * The payload is the JSON representation of the object metadata. It is
+ * converted in a single pass: a SAX handler maps each known field directly to
+ * its column, without building a DOM for the payload.
+ */
+spanner::Mutation UpdateObjectMetadata(std::string_view payload);
+
+/// Convert the payload of a GCS object deletion event into a `gcs_objects`
+/// delete.
+spanner::Mutation DeleteObjectMetadata(std::string_view payload);
+
+/// Parse a RFC 3339 timestamp, such as `2021-07-01T12:34:56.789Z`. Returns an
+/// empty optional if @p value is not in the fixed format used by GCS.
+absl::optional<spanner::Timestamp> ParseRfc3339(std::string_view value);
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_GETTING_STARTED_UPDATE_EVENT_CONVERTER_H
@@ -0,0 +1,100 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measure how many events/s `UpdateObjectMetadata()` can convert.
+//
+// Usage: event_converter_benchmark [payloads.jsonl] [iterations]
+//
+// The optional input file contains one recorded event payload (the `data`
+// field of the CloudEvent) per line. Without it the benchmark uses a typical
+// payload. As a reference, the benchmark also reports the rate for just
+// parsing the payloads into a `nlohmann::json` DOM.
+
+#include "event_converter.h"
+#include <nlohmann/json.hpp>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+using google::cloud::cpp_samples::UpdateObjectMetadata;
+
+auto constexpr kSamplePayload = R"""({
+  "kind": "storage#object",
+  "id": "sample-bucket/path/to/object.txt/1625140800123456",
+  "name": "path/to/object.txt",
+  "bucket": "sample-bucket",
+  "generation": "1625140800123456",
+  "metageneration": "1",
+  "contentType": "text/plain",
+  "storageClass": "STANDARD",
+  "size": "1234",
+  "md5Hash": "1B2M2Y8AsgTpgAmY7PhCfg==",
+  "crc32c": "AAAAAA==",
+  "etag": "CMDs7q3j6vECEAE=",
+  "timeCreated": "2021-07-01T12:00:00.123Z",
+  "updated": "2021-07-01T12:00:00.123Z",
+  "timeStorageClassUpdated": "2021-07-01T12:00:00.123Z",
+  "metadata": {"source": "benchmark", "owner-team": "storage"}
+})""";
+
+std::vector<std::string> LoadPayloads(char const* filename) {
+  if (filename == nullptr) return {kSamplePayload};
+  std::ifstream is(filename);
+  if (!is) throw std::runtime_error("cannot open " + std::string(filename));
+  std::vector<std::string> payloads;
+  for (std::string line; std::getline(is, line);) {
+    if (!line.empty()) payloads.push_back(std::move(line));
+  }
+  if (payloads.empty()) throw std::runtime_error("no payloads in input file");
+  return payloads;
+}
+
+template <typename Functor>
+void Run(std::string const& label, std::vector<std::string> const& payloads,
+         long iterations, Functor&& f) {
+  auto const start = std::chrono::steady_clock::now();
+  std::size_t checksum = 0;
+  for (long i = 0; i != iterations; ++i) {
+    for (auto const& p : payloads) checksum += f(p);
+  }
+  using seconds = std::chrono::duration<double>;
+  auto const elapsed = std::chrono::duration_cast<seconds>(
+      std::chrono::steady_clock::now() - start);
+  auto const events = static_cast<double>(iterations) * payloads.size();
+  std::cout << label << ": events=" << events
+            << ", elapsed=" << elapsed.count() << "s"
+            << ", events/s=" << events / elapsed.count()
+            << ", checksum=" << checksum << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) try {
+  auto const payloads = LoadPayloads(argc > 1 ? argv[1] : nullptr);
+  auto const iterations = argc > 2 ? std::stol(argv[2]) : 100'000L;
+
+  Run("nlohmann::json::parse", payloads, iterations,
+      [](std::string const& p) { return nlohmann::json::parse(p).size(); });
+  Run("UpdateObjectMetadata", payloads, iterations, [](std::string const& p) {
+    return UpdateObjectMetadata(p).as_proto().ByteSizeLong();
+  });
+  return 0;
+} catch (std::exception const& ex) {
+  std::cerr << "Standard C++ exception thrown: " << ex.what() << "\n";
+  return 1;
+}
@@ -0,0 +1,99 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gcs_objects_schema.h"
+#include <google/cloud/spanner/timestamp.h>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+namespace google::cloud::cpp_samples {
+
+std::vector<std::string> const& ObjectColumnNames() {
+  static auto const names = [] {
+    std::vector<std::string> names;
+    for (auto const& c : kObjectColumns) names.emplace_back(c.name);
+    return names;
+  }();
+  return names;
+}
+
+absl::optional<ObjectColumn> FindObjectColumn(std::string_view name) {
+  auto const i = std::lower_bound(
+      kObjectColumns.begin(), kObjectColumns.end(), name,
+      [](ColumnSchema const& c, std::string_view n) { return c.name < n; });
+  if (i == kObjectColumns.end() || i->name != name) return absl::nullopt;
+  return static_cast<ObjectColumn>(i - kObjectColumns.begin());
+}
+
+spanner::Value NullValue(ColumnType type) {
+  switch (type) {
+    case ColumnType::kInt64:
+      return spanner::Value(absl::optional<std::int64_t>());
+    case ColumnType::kBool:
+      return spanner::Value(absl::optional<bool>());
+    case ColumnType::kTimestamp:
+      return spanner::Value(absl::optional<spanner::Timestamp>());
+    case ColumnType::kString:
+    case ColumnType::kJson:
+      break;
+  }
+  return spanner::Value(absl::optional<std::string>());
+}
+
+spanner::Mutation ObjectRow::MakeUpsert() {
+  for (std::size_t i = 0; i != kObjectColumns.size(); ++i) {
+    if (present_[i]) continue;
+    if (kObjectColumns[i].required) {
+      throw std::runtime_error("missing required field " +
+                               std::string(kObjectColumns[i].name));
+    }
+    values_[i] = NullValue(kObjectColumns[i].type);
+  }
+  auto mutation =
+      spanner::InsertOrUpdateMutationBuilder("gcs_objects", ObjectColumnNames())
+          .AddRow(std::move(values_))
+          .Build();
+  Reset();
+  return mutation;
+}
+
+spanner::Mutation ObjectRow::MakeDelete() {
+  spanner::Key key{
+      std::move(Required(ObjectColumn::kBucket)),
+      std::move(Required(ObjectColumn::kName)),
+      std::move(Required(ObjectColumn::kGeneration)),
+  };
+  Reset();
+  return spanner::DeleteMutationBuilder(
+             "gcs_objects", spanner::KeySet().AddKey(std::move(key)))
+      .Build();
+}
+
+void ObjectRow::Reset() {
+  // After a move `values_` is in a valid but unspecified state.
+  values_.clear();
+  values_.resize(kObjectColumnCount);
+  present_.fill(false);
+}
+
+spanner::Value& ObjectRow::Required(ObjectColumn c) {
+  if (!has(c)) {
+    throw std::runtime_error("missing required field " +
+                             std::string(kObjectColumns[Index(c)].name));
+  }
+  return values_[Index(c)];
+}
+
+}  // namespace google::cloud::cpp_samples
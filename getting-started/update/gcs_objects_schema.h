@@ -0,0 +1,167 @@
+// Copyright 2021 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_GETTING_STARTED_UPDATE_GCS_OBJECTS_SCHEMA_H
+#define CPP_SAMPLES_GETTING_STARTED_UPDATE_GCS_OBJECTS_SCHEMA_H
+
+#include <absl/types/optional.h>
+#include <google/cloud/spanner/mutations.h>
+#include <google/cloud/spanner/value.h>
+#include <array>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace google::cloud::cpp_samples {
+
+enum class ColumnType { kString, kInt64, kBool, kTimestamp, kJson };
+
+struct ColumnSchema {
+  std::string_view name;
+  ColumnType type;
+  // Required columns are part of the primary key or `NOT NULL`.
+  bool required;
+};
+
+/// The columns in the `gcs_objects` table, in the same order as
+/// `kObjectColumns`.
+enum class ObjectColumn : std::size_t {
+  kBucket,
+  kCacheControl,
+  kComponentCount,
+  kContentDisposition,
+  kContentEncoding,
+  kContentLanguage,
+  kContentType,
+  kCrc32c,
+  kCustomTime,
+  kCustomerEncryption,
+  kEtag,
+  kEventBasedHold,
+  kGeneration,
+  kKmsKeyName,
+  kMd5Hash,
+  kMetadata,
+  kMetageneration,
+  kName,
+  kOwner,
+  kRetentionExpirationTime,
+  kSize,
+  kStorageClass,
+  kTemporaryHold,
+  kTimeCreated,
+  kTimeDeleted,
+  kTimeStorageClassUpdated,
+  kUpdated,
+};
+
+auto constexpr kObjectColumnCount =
+    static_cast<std::size_t>(ObjectColumn::kUpdated) + 1;
+
+/**
+ * The schema for the `gcs_objects` table.
+ *
+ * This must be kept in sync with `gcs_objects.sql`. The column names match the
+ * JSON API field names, and are sorted, so the columns for a JSON field can be
+ * found using a binary search.
+ */
+inline constexpr std::array<ColumnSchema, kObjectColumnCount> kObjectColumns{{
+    {"bucket", ColumnType::kString, true},
+    {"cacheControl", ColumnType::kString, false},
+    {"componentCount", ColumnType::kInt64, false},
+    {"contentDisposition", ColumnType::kString, false},
+    {"contentEncoding", ColumnType::kString, false},
+    {"contentLanguage", ColumnType::kString, false},
+    {"contentType", ColumnType::kString, false},
+    {"crc32c", ColumnType::kString, false},
+    {"customTime", ColumnType::kTimestamp, false},
+    {"customerEncryption", ColumnType::kJson, false},
+    {"etag", ColumnType::kString, false},
+    {"eventBasedHold", ColumnType::kBool, false},
+    {"generation", ColumnType::kInt64, true},
+    {"kmsKeyName", ColumnType::kString, false},
+    {"md5Hash", ColumnType::kString, false},
+    {"metadata", ColumnType::kJson, false},
+    {"metageneration", ColumnType::kInt64, true},
+    {"name", ColumnType::kString, true},
+    {"owner", ColumnType::kJson, false},
+    {"retentionExpirationTime", ColumnType::kTimestamp, false},
+    {"size", ColumnType::kInt64, false},
+    {"storageClass", ColumnType::kString, false},
+    {"temporaryHold", ColumnType::kBool, false},
+    {"timeCreated", ColumnType::kTimestamp, false},
+    {"timeDeleted", ColumnType::kTimestamp, false},
+    {"timeStorageClassUpdated", ColumnType::kTimestamp, false},
+    {"updated", ColumnType::kTimestamp, false},
+}};
+
+constexpr bool ColumnsAreSorted() {
+  for (std::size_t i = 1; i < kObjectColumns.size(); ++i) {
+    if (!(kObjectColumns[i - 1].name < kObjectColumns[i].name)) return false;
+  }
+  return true;
+}
+static_assert(ColumnsAreSorted(), "kObjectColumns must be sorted by name");
+
+constexpr std::size_t Index(ObjectColumn c) {
+  return static_cast<std::size_t>(c);
+}
+
+/// The column names, in the order used by `ObjectRow`.
+std::vector<std::string> const& ObjectColumnNames();
+
+/// The column for the JSON field @p name, or an empty optional if the field is
+/// not indexed.
+absl::optional<ObjectColumn> FindObjectColumn(std::string_view name);
+
+/// A typed null value for @p type.
+spanner::Value NullValue(ColumnType type);
+
+/**
+ * A buffer for one `gcs_objects` row.
+ *
+ * Converters write each column directly into its slot. `MakeUpsert()` and
+ * `MakeDelete()` move the values into a mutation and reset the row, so a
+ * converter can reuse the same `ObjectRow` for many objects.
+ */
+class ObjectRow {
+ public:
+  ObjectRow() { Reset(); }
+
+  void Set(ObjectColumn c, spanner::Value v) {
+    values_[Index(c)] = std::move(v);
+    present_[Index(c)] = true;
+  }
+  bool has(ObjectColumn c) const { return present_[Index(c)]; }
+
+  /// Create an upsert for the row. Missing columns are set to null, throws if
+  /// a required column is missing.
+  spanner::Mutation MakeUpsert();
+
+  /// Create a delete for the (bucket, name, generation) key of the row.
+  spanner::Mutation MakeDelete();
+
+  void Reset();
+
+ private:
+  spanner::Value& Required(ObjectColumn c);
+
+  std::vector<spanner::Value> values_;
+  std::array<bool, kObjectColumnCount> present_{};
+};
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_GETTING_STARTED_UPDATE_GCS_OBJECTS_SCHEMA_H
@@ -43,6 +43,7 @@ spec:
             '/r/populate_bucket', 'worker',
             '--project={{project}}',
             '--subscription=populate-bucket',
+            '--topic=populate-bucket',
             '--concurrency=16'
         ]
         resources:
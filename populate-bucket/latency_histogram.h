@@ -0,0 +1,125 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_POPULATE_BUCKET_LATENCY_HISTOGRAM_H
+#define CPP_SAMPLES_POPULATE_BUCKET_LATENCY_HISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace google::cloud::cpp_samples {
+
+/**
+ * A latency histogram with bounded relative error, in the style of
+ * HdrHistogram.
+ *
+ * Values are recorded in microseconds. Each power of two is divided in
+ * `kSubBuckets` linear buckets, so the percentiles are accurate to about 6%,
+ * for values up to about 40 hours. Larger values are counted in the last
+ * bucket.
+ *
+ * Recording is lock-free and can be called from any thread. `collect()` reads
+ * and resets the counts, each call returns the values recorded since the
+ * previous call. Values recorded during a `collect()` call may be reported in
+ * either interval, but are never lost.
+ */
+class latency_histogram {
+ public:
+  static auto constexpr kSubBucketBits = 4;
+  static auto constexpr kSubBuckets = 1 << kSubBucketBits;
+  static auto constexpr kMaxOctave = 32;
+  static auto constexpr kBucketCount = (kMaxOctave + 2) * kSubBuckets;
+
+  /// The values recorded in one interval.
+  class snapshot {
+   public:
+    std::int64_t count() const { return count_; }
+    std::chrono::microseconds max() const {
+      return std::chrono::microseconds(max_);
+    }
+    /// The value at percentile @p p, in [0, 100].
+    std::chrono::microseconds percentile(double p) const {
+      if (count_ == 0) return std::chrono::microseconds(0);
+      auto rank = static_cast<std::int64_t>(p / 100.0 * count_ + 0.5);
+      rank = rank < 1 ? 1 : (rank > count_ ? count_ : rank);
+      std::int64_t seen = 0;
+      for (std::size_t i = 0; i != counts_.size(); ++i) {
+        seen += counts_[i];
+        if (seen < rank) continue;
+        // The last bucket has no upper bound.
+        if (i + 1 == counts_.size()) break;
+        auto const v = upper_bound(i);
+        return std::chrono::microseconds(v < max_ ? v : max_);
+      }
+      return max();
+    }
+
+   private:
+    friend class latency_histogram;
+    std::vector<std::int64_t> counts_;
+    std::int64_t count_ = 0;
+    std::int64_t max_ = 0;
+  };
+
+  void record(std::chrono::steady_clock::duration latency) {
+    auto const us = std::chrono::duration_cast<std::chrono::microseconds>(
+                        latency)
+                        .count();
+    auto const v = us < 0 ? 0 : us;
+    counts_[bucket(v)].fetch_add(1, std::memory_order_relaxed);
+    auto m = max_.load(std::memory_order_relaxed);
+    while (v > m and not max_.compare_exchange_weak(m, v)) {
+    }
+  }
+
+  snapshot collect() {
+    snapshot s;
+    s.counts_.resize(counts_.size());
+    for (std::size_t i = 0; i != counts_.size(); ++i) {
+      s.counts_[i] = counts_[i].exchange(0, std::memory_order_relaxed);
+      s.count_ += s.counts_[i];
+    }
+    s.max_ = max_.exchange(0);
+    return s;
+  }
+
+ private:
+  // Values below `2 * kSubBuckets` have their own bucket. Larger values are
+  // in octave `n` if their top `kSubBucketBits + 1` bits start at bit `n`,
+  // and those bits select the bucket within the octave.
+  static std::size_t bucket(std::int64_t v) {
+    auto const u = static_cast<std::uint64_t>(v);
+    if (u < 2 * kSubBuckets) return static_cast<std::size_t>(u);
+    auto const octave = 63 - __builtin_clzll(u) - kSubBucketBits;
+    if (octave > kMaxOctave) return kBucketCount - 1;
+    return static_cast<std::size_t>(octave * kSubBuckets + (u >> octave));
+  }
+
+  static std::int64_t upper_bound(std::size_t i) {
+    if (i < 2 * kSubBuckets) return static_cast<std::int64_t>(i);
+    auto const octave = i / kSubBuckets - 1;
+    auto const top = i - octave * kSubBuckets;
+    return static_cast<std::int64_t>(((top + 1) << octave) - 1);
+  }
+
+  std::array<std::atomic<std::int64_t>, kBucketCount> counts_{};
+  std::atomic<std::int64_t> max_{0};
+};
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_POPULATE_BUCKET_LATENCY_HISTOGRAM_H
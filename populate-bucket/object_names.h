@@ -0,0 +1,140 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef CPP_SAMPLES_POPULATE_BUCKET_OBJECT_NAMES_H
+#define CPP_SAMPLES_POPULATE_BUCKET_OBJECT_NAMES_H
+
+#include <crc32c/crc32c.h>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+
+namespace google::cloud::cpp_samples {
+
+/**
+ * A fast pseudo-random number generator, SplitMix64.
+ *
+ * The generated names only need to be unique and well distributed, this is
+ * much cheaper to seed and to run than `std::mt19937_64`. It satisfies the
+ * requirements of a UniformRandomBitGenerator.
+ */
+class fast_random {
+ public:
+  using result_type = std::uint64_t;
+
+  explicit fast_random(std::uint64_t seed) : state_(seed) {}
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  result_type operator()() {
+    auto x = state_ += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
+
+ private:
+  std::uint64_t state_;
+};
+
+/**
+ * Write @p n random characters from `[a-z0-9]` to @p out.
+ *
+ * Each character uses 16 random bits, mapped to the alphabet with a multiply
+ * and shift, followed by a branch-free select between letters and digits.
+ * The compiler vectorizes this loop.
+ */
+inline void random_alphanum(fast_random& gen, char* out, std::size_t n) {
+  auto constexpr kChunk = std::size_t{32};
+  std::uint16_t bits[kChunk];
+  while (n != 0) {
+    for (std::size_t i = 0; i != kChunk; i += 4) {
+      auto const v = gen();
+      std::memcpy(bits + i, &v, sizeof(v));
+    }
+    auto const count = n < kChunk ? n : kChunk;
+    for (std::size_t i = 0; i != count; ++i) {
+      // Maps [0, 65536) to [0, 36), the bias is below 0.1%.
+      auto const index = static_cast<std::uint32_t>(bits[i]) * 36 >> 16;
+      auto const digit = static_cast<std::uint32_t>(index >= 26);
+      out[i] = static_cast<char>(index + 'a' - digit * ('a' - '0' + 26));
+    }
+    out += count;
+    n -= count;
+  }
+}
+
+/**
+ * Generate the object names in a work item, reusing a single buffer.
+ *
+ * The names are `<prefix>/object-<index>`, optionally preceded by the
+ * `crc32c` of the name, as 8 hex digits and an underscore, to spread the
+ * objects across the bucket key space. Once the buffer has grown to the
+ * longest name, generating names does not allocate memory.
+ */
+class object_name_generator {
+ public:
+  object_name_generator() = default;
+
+  /// Start generating the names for a new prefix.
+  void reset(std::string const& prefix, bool use_hash_prefix) {
+    name_.clear();
+    if (use_hash_prefix) name_.append(kHashSize, '0');
+    name_start_ = name_.size();
+    name_.append(prefix);
+    name_.append("/object-");
+    index_start_ = name_.size();
+  }
+
+  /// The name of the object at @p index, which must not be negative. The
+  /// result is valid until the next call.
+  std::string const& name(std::int64_t index) {
+    char digits[24];
+    auto* end = digits + sizeof(digits);
+    auto* p = end;
+    auto v = static_cast<std::uint64_t>(index);
+    do {
+      *--p = static_cast<char>('0' + v % 10);
+      v /= 10;
+    } while (v != 0);
+    name_.resize(index_start_);
+    name_.append(p, end);
+    if (name_start_ == 0) return name_;
+
+    auto hash = crc32c::Crc32c(name_.data() + name_start_,
+                               name_.size() - name_start_);
+    char const hex[] = "0123456789abcdef";
+    for (auto i = kHashSize - 1; i != 0; --i, hash >>= 4) {
+      name_[i - 1] = hex[hash & 0xf];
+    }
+    name_[kHashSize - 1] = '_';
+    return name_;
+  }
+
+ private:
+  // 8 hex digits and an underscore.
+  static auto constexpr kHashSize = std::size_t{9};
+
+  std::string name_;
+  std::size_t name_start_ = 0;
+  std::size_t index_start_ = 0;
+};
+
+}  // namespace google::cloud::cpp_samples
+
+#endif  // CPP_SAMPLES_POPULATE_BUCKET_OBJECT_NAMES_H
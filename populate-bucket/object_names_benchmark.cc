@@ -0,0 +1,94 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "object_names.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+
+namespace {
+namespace cpp_samples = google::cloud::cpp_samples;
+
+// The original implementation, kept as a baseline.
+std::string legacy_alphanum_string(std::mt19937_64& gen, int n) {
+  char const alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+  std::string result;
+  std::generate_n(std::back_inserter(result), n, [&] {
+    return alphabet[std::uniform_int_distribution<int>(
+        0, sizeof(alphabet) - 2)(gen)];
+  });
+  return result;
+}
+
+std::string legacy_hashed_name(std::string object_name) {
+  auto const hash = crc32c::Crc32c(object_name);
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "%08x_", hash);
+  return buf + object_name;
+}
+
+template <typename Functor>
+void run(char const* name, long iterations, Functor&& f) {
+  using clock = std::chrono::steady_clock;
+  std::size_t checksum = 0;
+  auto const start = clock::now();
+  for (long i = 0; i != iterations; ++i) checksum += f(i);
+  auto const elapsed = std::chrono::duration<double>(clock::now() - start);
+  std::cout << name << ": " << iterations / elapsed.count()
+            << " names/s, checksum=" << checksum << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  auto const iterations = argc > 1 ? std::stol(argv[1]) : 10'000'000L;
+  auto constexpr kTaskSize = 1000;
+
+  // Each task has a new random prefix, and `kTaskSize` objects.
+  std::mt19937_64 legacy_gen(42);
+  std::string legacy_prefix;
+  run("legacy", iterations, [&](long i) {
+    if (i % kTaskSize == 0) {
+      legacy_prefix = "name-" + legacy_alphanum_string(legacy_gen, 32);
+    }
+    auto name = legacy_hashed_name(legacy_prefix + "/object-" +
+                                   std::to_string(i % kTaskSize));
+    return name.size() + static_cast<unsigned char>(name[0]);
+  });
+
+  cpp_samples::fast_random gen(42);
+  cpp_samples::object_name_generator names;
+  char prefix[38] = "name-";
+  run("generator", iterations, [&](long i) {
+    if (i % kTaskSize == 0) {
+      cpp_samples::random_alphanum(gen, prefix + 5, 32);
+      names.reset(prefix, true);
+    }
+    auto const& name = names.name(i % kTaskSize);
+    return name.size() + static_cast<unsigned char>(name[0]);
+  });
+
+  // Generating prefixes is rare in practice, this measures the alphabet
+  // mapping on its own.
+  run("random_alphanum(32)", iterations, [&](long) {
+    cpp_samples::random_alphanum(gen, prefix + 5, 32);
+    return static_cast<unsigned char>(prefix[5]);
+  });
+
+  return 0;
+}
@@ -12,20 +12,41 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "latency_histogram.h"
+#include "object_names.h"
 #include <boost/program_options.hpp>
 #include <crc32c/crc32c.h>
 #include <google/cloud/pubsub/publisher.h>
 #include <google/cloud/pubsub/subscriber.h>
 #include <google/cloud/storage/client.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cinttypes>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <random>
+#include <sstream>
 #include <thread>
 #include <tuple>
 #include <vector>
 
 namespace {
 namespace po = boost::program_options;
+namespace cpp_samples = google::cloud::cpp_samples;
 namespace gcs = google::cloud::storage;
 namespace pubsub = google::cloud::pubsub;
 
@@ -34,6 +55,10 @@ std::tuple<po::variables_map, po::options_description> parse_command_line(
 
 void schedule(po::variables_map const&);
 void worker(po::variables_map const&);
+void local(po::variables_map const&);
+void load(po::variables_map const&);
+void cleanup(po::variables_map const&);
+void verify(po::variables_map const&);
 
 }  // namespace
 
@@ -52,6 +77,10 @@ int main(int argc, char* argv[]) try {
       {"help", help},
       {"schedule", schedule},
       {"worker", worker},
+      {"local", local},
+      {"load", load},
+      {"cleanup", cleanup},
+      {"verify", verify},
   };
 
   auto const action_name = vm["action"].as<std::string>();
@@ -91,6 +120,12 @@ std::tuple<po::variables_map, po::options_description> parse_command_line(
        "the execution mode:\n"
        "- `schedule` to setup a number of work items in the task queue\n"
        "- `worker` to run as a worker listening on the task queue\n"
+       "- `local` to populate the bucket from this process, without a task "
+       "queue\n"
+       "- `load` to create objects at a target rate, and report their "
+       "latency\n"
+       "- `cleanup` to delete the objects created by this program\n"
+       "- `verify` to check the objects created by a job\n"
        "- `help` to produce some help\n")
       //
       ("project",
@@ -101,7 +136,9 @@ std::tuple<po::variables_map, po::options_description> parse_command_line(
       ("subscription", po::value<std::string>(),
        "set the Cloud Pub/Sub subscription")
       //
-      ("topic", po::value<std::string>(), "set the Cloud Pub/Sub topic")
+      ("topic", po::value<std::string>(),
+       "set the Cloud Pub/Sub topic, required by the `schedule` and `worker` "
+       "actions, the workers publish sub-ranges to this topic")
       //
       ("bucket", po::value<std::string>(), "set the destination bucket name")
       //
@@ -112,11 +149,55 @@ std::tuple<po::variables_map, po::options_description> parse_command_line(
        "prefix the object names with a hash to avoid hot spots in GCS")
       //
       ("task-size", po::value<long>()->default_value(default_minimum_item_size),
-       "each work item created by schedule-job should contain this number of "
-       "objects")
+       "the objects are created in tasks of this size, the objects in each "
+       "task share a prefix")
+      //
+      ("range-size", po::value<long>()->default_value(1'000'000L),
+       "each work item published by the `schedule` action describes this "
+       "number of objects, the workers split it into tasks")
+      //
+      ("split-fanout", po::value<int>()->default_value(16),
+       "the number of sub-ranges created when a worker splits a range")
+      //
+      ("seed", po::value<std::uint64_t>(),
+       "the seed for the object names, by default a random seed is used. The "
+       "`verify` action requires the seed used to create the objects")
+      //
+      ("object-size-distribution",
+       po::value<std::string>()->default_value("fixed:0"),
+       "the distribution of object sizes: `fixed:SIZE`, `uniform:MIN:MAX`, "
+       "`lognormal:MEDIAN:SIGMA[:MAX]`, `histogram:BOUND=COUNT,...`, or "
+       "`histogram-file:PATH`. Objects are never smaller than the description "
+       "of their contents")
+      //
+      ("compressible-fraction", po::value<double>()->default_value(0.0),
+       "the fraction of each 4KiB block in the object payloads filled with "
+       "zeros")
+      //
+      ("target-rate", po::value<double>()->default_value(100.0),
+       "the `load` action creates objects at this rate, in objects/s")
+      //
+      ("ramp-up", po::value<int>()->default_value(0),
+       "the `load` action increases the rate linearly over this time, in "
+       "seconds")
+      //
+      ("duration", po::value<int>()->default_value(60),
+       "the duration of the `load` action, in seconds")
       //
       ("concurrency", po::value<int>()->default_value(8),
-       "number of parallel handlers to handle work items");
+       "number of parallel handlers to handle work items, or threads in the "
+       "`local` and `schedule` actions")
+      //
+      ("max-outstanding-publishes", po::value<long>()->default_value(10'000L),
+       "maximum number of work items published but not yet acknowledged by "
+       "Cloud Pub/Sub")
+      //
+      ("list-concurrency", po::value<int>()->default_value(16),
+       "number of threads listing the bucket in the `cleanup` and `verify` "
+       "actions")
+      //
+      ("insert-concurrency", po::value<int>()->default_value(16),
+       "number of concurrent object inserts within each work item");
 
   po::variables_map vm;
   po::store(po::command_line_parser(argc, argv)
@@ -129,57 +210,344 @@ std::tuple<po::variables_map, po::options_description> parse_command_line(
   return {vm, desc};
 }
 
-/// Create a random object name fragment.
-std::string random_alphanum_string(std::mt19937_64& gen, int n) {
-  char const alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
-  std::string result;
-  std::generate_n(std::back_inserter(result), n, [&] {
-    return alphabet[std::uniform_int_distribution<int>(
-        0, sizeof(alphabet) - 1)(gen)];
-  });
-  return result;
+/// Create a unique prefix for the work item starting at @p offset.
+std::string random_prefix(cpp_samples::fast_random& gen, long offset) {
+  char buf[64] = "name-";
+  cpp_samples::random_alphanum(gen, buf + 5, 32);
+  std::snprintf(buf + 37, sizeof(buf) - 37, "-offset-%08" PRIx64,
+                static_cast<std::uint64_t>(offset));
+  return buf;
 }
 
-/// Prepend a hash to an object name for better performance in GCS.
-std::string hashed_name(bool use_hash_prefix, std::string object_name) {
-  if (not use_hash_prefix) return std::move(object_name);
+/**
+ * The distribution of object sizes.
+ *
+ * The distribution is described by a string, which is included in the work
+ * items:
+ * - `fixed:SIZE`
+ * - `uniform:MIN:MAX`
+ * - `lognormal:MEDIAN:SIGMA`, or `lognormal:MEDIAN:SIGMA:MAX` to limit the
+ *   size of the largest objects.
+ * - `histogram:BOUND=COUNT,BOUND=COUNT,...`, the sizes are uniformly
+ *   distributed between the previous bound and `BOUND`.
+ * - `histogram-file:PATH`, a histogram with one `BOUND COUNT` pair per line,
+ *   which is converted to the `histogram:` form.
+ *
+ * Each object size is sampled using a key derived from the object name, so
+ * the same object always has the same size.
+ */
+class size_distribution {
+ public:
+  explicit size_distribution(std::string const& spec);
+
+  std::string const& spec() const { return spec_; }
+  std::int64_t sample(std::uint64_t key) const;
 
-  // Just use the last 32-bits of the hash
-  auto const hash = crc32c::Crc32c(object_name);
+ private:
+  enum class kind { fixed, uniform, lognormal, histogram };
+
+  std::string spec_;
+  kind kind_ = kind::fixed;
+  std::int64_t size_ = 0;
+  std::int64_t max_size_ = 0;
+  double sigma_ = 0;
+  std::vector<std::int64_t> bounds_;
+  std::vector<double> cumulative_;
+};
 
-  char buf[16];
-  std::snprintf(buf, sizeof(buf), "%08x_", hash);
-  return buf + object_name;
+std::vector<std::string> split(std::string const& s, char separator) {
+  std::vector<std::string> result;
+  std::string::size_type start = 0;
+  for (auto end = s.find(separator); end != std::string::npos;
+       start = end + 1, end = s.find(separator, start)) {
+    result.push_back(s.substr(start, end - start));
+  }
+  result.push_back(s.substr(start));
+  return result;
 }
 
+size_distribution::size_distribution(std::string const& spec) : spec_(spec) {
+  auto invalid = [&spec] {
+    return std::runtime_error("invalid object size distribution: " + spec);
+  };
+  auto const fields = split(spec, ':');
+  auto const& name = fields.front();
+  if (name == "fixed" and fields.size() == 2) {
+    size_ = std::stoll(fields[1]);
+    return;
+  }
+  if (name == "uniform" and fields.size() == 3) {
+    kind_ = kind::uniform;
+    size_ = std::stoll(fields[1]);
+    max_size_ = std::stoll(fields[2]);
+    if (max_size_ < size_) throw invalid();
+    return;
+  }
+  if (name == "lognormal" and (fields.size() == 3 or fields.size() == 4)) {
+    kind_ = kind::lognormal;
+    size_ = std::stoll(fields[1]);
+    sigma_ = std::stod(fields[2]);
+    if (fields.size() == 4) max_size_ = std::stoll(fields[3]);
+    if (size_ <= 0 or sigma_ < 0) throw invalid();
+    return;
+  }
+  std::vector<std::pair<std::int64_t, double>> buckets;
+  if (name == "histogram" and fields.size() == 2) {
+    for (auto const& b : split(fields[1], ',')) {
+      auto const kv = split(b, '=');
+      if (kv.size() != 2) throw invalid();
+      buckets.emplace_back(std::stoll(kv[0]), std::stod(kv[1]));
+    }
+  } else if (name == "histogram-file" and fields.size() == 2) {
+    std::ifstream is(fields[1]);
+    if (not is) throw invalid();
+    std::int64_t bound;
+    double count;
+    while (is >> bound >> count) buckets.emplace_back(bound, count);
+    if (not is.eof()) throw invalid();
+  } else {
+    throw invalid();
+  }
+  if (buckets.empty()) throw invalid();
+  std::sort(buckets.begin(), buckets.end());
+  kind_ = kind::histogram;
+  std::ostringstream os;
+  os << "histogram:";
+  double total = 0;
+  for (auto const& [bound, count] : buckets) {
+    if (count < 0) throw invalid();
+    os << (bounds_.empty() ? "" : ",") << bound << "=" << count;
+    bounds_.push_back(bound);
+    cumulative_.push_back(total += count);
+  }
+  if (total <= 0) throw invalid();
+  spec_ = std::move(os).str();
+}
+
+std::int64_t size_distribution::sample(std::uint64_t key) const {
+  auto gen = cpp_samples::fast_random(key);
+  switch (kind_) {
+    case kind::fixed:
+      break;
+    case kind::uniform:
+      return std::uniform_int_distribution<std::int64_t>(size_, max_size_)(gen);
+    case kind::lognormal: {
+      auto const v = std::lognormal_distribution<double>(
+          std::log(static_cast<double>(size_)), sigma_)(gen);
+      auto const size = static_cast<std::int64_t>(std::llround(v));
+      return max_size_ == 0 ? size : (std::min)(size, max_size_);
+    }
+    case kind::histogram: {
+      auto const r = std::uniform_real_distribution<double>(
+          0, cumulative_.back())(gen);
+      auto const i = static_cast<std::size_t>(
+          std::upper_bound(cumulative_.begin(), cumulative_.end(), r) -
+          cumulative_.begin());
+      auto const hi = bounds_[(std::min)(i, bounds_.size() - 1)];
+      auto const lo = i == 0 ? 0 : (std::min)(bounds_[i - 1] + 1, hi);
+      return std::uniform_int_distribution<std::int64_t>(lo, hi)(gen);
+    }
+  }
+  return size_;
+}
+
+/**
+ * Generate object payloads.
+ *
+ * Generating random data for each object is too expensive, instead each
+ * payload is a series of slices from a pool of random bytes. The pool is
+ * generated once per process, from a fixed seed, so any process generates the
+ * same payloads. Each payload starts at a different offset in the pool.
+ *
+ * With a compressible fraction, that fraction of each 4KiB block is filled
+ * with zeros, the rest of the block comes from the pool.
+ */
+class payload_generator {
+ public:
+  static auto constexpr kPoolSize = std::size_t{8} * 1024 * 1024;
+  static auto constexpr kBlockSize = std::size_t{4096};
+
+  static payload_generator const& instance() {
+    static auto const* const generator = new payload_generator;
+    return *generator;
+  }
+
+  /// Call @p sink with the slices for a payload of @p size bytes.
+  template <typename Sink>
+  void write(std::uint64_t key, std::int64_t size, double compressible_fraction,
+             Sink&& sink) const {
+    auto const zeros = static_cast<std::size_t>(std::llround(
+        (std::max)(0.0, (std::min)(compressible_fraction, 1.0)) * kBlockSize));
+    // With a compressible fraction the slices are block aligned.
+    auto offset = static_cast<std::size_t>(key % kPoolSize);
+    if (zeros != 0) offset -= offset % kBlockSize;
+    auto remaining =
+        static_cast<std::size_t>((std::max)(size, std::int64_t{0}));
+    while (remaining != 0) {
+      auto n = (std::min)(remaining, kPoolSize - offset);
+      if (zeros != 0) {
+        n = (std::min)(remaining, zeros);
+        sink(zeros_.data(), n);
+        remaining -= n;
+        n = (std::min)(remaining, kBlockSize - zeros);
+        if (n != 0) sink(pool_.data() + offset + zeros, n);
+        remaining -= n;
+        offset = (offset + kBlockSize) % kPoolSize;
+        continue;
+      }
+      sink(pool_.data() + offset, n);
+      remaining -= n;
+      offset = 0;
+    }
+  }
+
+ private:
+  payload_generator() : pool_(kPoolSize, '\0'), zeros_(kBlockSize, '\0') {
+    auto gen = std::mt19937_64(0x5eed);
+    for (std::size_t i = 0; i != kPoolSize; i += sizeof(std::uint64_t)) {
+      auto const v = gen();
+      std::memcpy(&pool_[i], &v, sizeof(v));
+    }
+  }
+
+  std::string pool_;
+  std::string zeros_;
+};
+
 struct work_item {
   std::string bucket;
   std::string prefix;
   std::int64_t object_count;
   bool use_hash_prefix;
+  std::shared_ptr<size_distribution const> object_sizes;
+  double compressible_fraction;
+};
+
+/**
+ * A range of objects, described by a seed.
+ *
+ * The objects are numbered from 0 to the object count of the job, and object
+ * `i` belongs to the group `i / task_size`. Each group is a `work_item`, with
+ * a prefix derived from the seed and the group number. Any range of objects
+ * can be created, or split, without coordination, and always produces the
+ * same names and contents.
+ */
+struct work_range {
+  std::string bucket;
+  std::uint64_t seed;
+  std::int64_t start;
+  std::int64_t count;
+  std::int64_t task_size;
+  bool use_hash_prefix;
+  std::shared_ptr<size_distribution const> object_sizes;
+  double compressible_fraction;
 };
 
-work_item parse_message(pubsub::Message const& m) {
+std::uint64_t random_seed() {
+  std::random_device rd;
+  return std::uint64_t{rd()} << 32 | rd();
+}
+
+/// The seed for a job, use `--seed` with the `verify` action to check the
+/// objects created by the job.
+std::uint64_t job_seed(po::variables_map const& vm) {
+  auto const seed = vm.count("seed") == 0 ? random_seed()
+                                          : vm["seed"].as<std::uint64_t>();
+  std::cout << "Using --seed=" << seed << std::endl;
+  return seed;
+}
+
+/// Mix the bits of @p x, the finalizer from SplitMix64.
+std::uint64_t mix_bits(std::uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/// The work item for group @p group in a range.
+work_item group_item(work_range const& r, std::int64_t group) {
+  auto gen = cpp_samples::fast_random(mix_bits(r.seed + group));
+  return work_item{r.bucket,         random_prefix(gen, group * r.task_size),
+                   r.task_size,      r.use_hash_prefix,
+                   r.object_sizes,   r.compressible_fraction};
+}
+
+work_range parse_range(pubsub::Message const& m) {
   auto attributes = m.attributes();
-  return work_item{
+  return work_range{
       attributes.at("bucket"),
-      attributes.at("prefix"),
-      std::stoll(attributes.at("object_count")),
+      std::stoull(attributes.at("seed")),
+      std::stoll(attributes.at("start")),
+      std::stoll(attributes.at("count")),
+      std::stoll(attributes.at("task_size")),
       attributes.at("use_hash_prefix") == "true",
+      std::make_shared<size_distribution const>(m.data()),
+      std::stod(attributes.at("compressible_fraction")),
   };
 }
 
-pubsub::Message format_work_item(work_item wi) {
+pubsub::Message format_range(work_range r) {
+  // The workers must use the exact value, as the `local` and `verify` actions
+  // do, `std::to_string()` would round it to 6 decimal places.
+  char fraction[32];
+  std::snprintf(fraction, sizeof(fraction), "%.17g", r.compressible_fraction);
   return pubsub::MessageBuilder()
       .SetAttributes({
-          {"bucket", std::move(wi.bucket)},
-          {"prefix", std::move(wi.prefix)},
-          {"object_count", std::to_string(wi.object_count)},
-          {"use_hash_prefix", wi.object_count ? "true" : "false"},
+          {"bucket", std::move(r.bucket)},
+          {"seed", std::to_string(r.seed)},
+          {"start", std::to_string(r.start)},
+          {"count", std::to_string(r.count)},
+          {"task_size", std::to_string(r.task_size)},
+          {"use_hash_prefix", r.use_hash_prefix ? "true" : "false"},
+          {"compressible_fraction", fraction},
       })
+      // The distribution may be too large for an attribute value.
+      .SetData(r.object_sizes->spec())
       .Build();
 }
 
+/**
+ * Bound the number of publish calls in flight, and count their results.
+ *
+ * This is a counting semaphore: `acquire()` blocks while @p max_outstanding
+ * calls are pending, and each completed call releases its slot. The status
+ * codes are aggregated as the calls complete, so no futures are retained.
+ */
+class publish_window {
+ public:
+  explicit publish_window(std::int64_t max_outstanding)
+      : available_(max_outstanding) {}
+
+  void acquire() {
+    std::unique_lock<std::mutex> lk(mu_);
+    cv_.wait(lk, [this] { return available_ > 0; });
+    --available_;
+    ++outstanding_;
+  }
+
+  void release(google::cloud::Status const& status) {
+    std::lock_guard<std::mutex> lk(mu_);
+    ++available_;
+    --outstanding_;
+    if (not status.ok()) ++error_count_[status.code()];
+    cv_.notify_all();
+  }
+
+  /// Wait for all the calls to complete, and return the count of each error.
+  std::map<google::cloud::StatusCode, std::int64_t> wait() {
+    std::unique_lock<std::mutex> lk(mu_);
+    cv_.wait(lk, [this] { return outstanding_ == 0; });
+    return error_count_;
+  }
+
+ private:
+  std::mutex mu_;
+  std::condition_variable cv_;
+  std::int64_t available_;
+  std::int64_t outstanding_ = 0;
+  std::map<google::cloud::StatusCode, std::int64_t> error_count_;
+};
+
 /// Create all the work items to populate a bucket
 void schedule(boost::program_options::variables_map const& vm) {
   std::cout << "Scheduling jobs through work queue" << std::endl;
@@ -196,46 +564,70 @@ void schedule(boost::program_options::variables_map const& vm) {
   auto const bucket = vm["bucket"].as<std::string>();
   auto const object_count = vm["object-count"].as<long>();
   auto const use_hash_prefix = vm["use-hash-prefix"].as<bool>();
-  auto const task_size = vm["task-size"].as<long>();
+  auto const task_size = (std::max)(1L, vm["task-size"].as<long>());
+  // Round up, so each range contains complete groups.
+  auto const range_size =
+      ((std::max)(vm["range-size"].as<long>(), task_size) + task_size - 1) /
+      task_size * task_size;
+  auto const concurrency = (std::max)(1, vm["concurrency"].as<int>());
+  auto const max_outstanding = vm["max-outstanding-publishes"].as<long>();
+  auto const object_sizes = std::make_shared<size_distribution const>(
+      vm["object-size-distribution"].as<std::string>());
+  auto const compressible_fraction = vm["compressible-fraction"].as<double>();
   auto const project_id = vm["project"].as<std::string>();
   auto const topic_id = vm["topic"].as<std::string>();
 
+  // Work items are small, batch as many as possible in each request. The hold
+  // time is short because the threads generate work items quickly.
+  using namespace std::chrono_literals;
   auto const topic = pubsub::Topic(project_id, topic_id);
-  auto publisher =
-      pubsub::Publisher(pubsub::MakePublisherConnection(topic, {}));
-
-  auto make_prefix = [g = std::mt19937_64(std::random_device{}())](
-                         long offset) mutable {
-    std::ostringstream os;
-    os << "name-" << random_alphanum_string(g, 32) << "-offset-" << std::setw(8)
-       << std::setfill('0') << std::hex << static_cast<std::int64_t>(offset);
-    return std::move(os).str();
+  auto publisher = pubsub::Publisher(pubsub::MakePublisherConnection(
+      topic, pubsub::PublisherOptions{}
+                 .set_maximum_batch_message_count(1000)
+                 .set_maximum_batch_bytes(8 * 1024 * 1024)
+                 .set_maximum_hold_time(10ms)));
+  publish_window window((std::max)(1L, max_outstanding));
+
+  // The workers split each range into groups of `task_size` objects, most
+  // jobs need only a few ranges. Each thread publishes a contiguous block of
+  // the ranges.
+  auto const seed = job_seed(vm);
+  auto const item_count = (object_count + range_size - 1) / range_size;
+  std::atomic<long> published{0};
+  auto const report_every = (std::max)(1L, item_count / 10);
+  auto generator = [&](long begin, long end) {
+    for (auto item = begin; item != end; ++item) {
+      auto const offset = item * range_size;
+      auto r = work_range{bucket,
+                          seed,
+                          offset,
+                          (std::min)(range_size, object_count - offset),
+                          task_size,
+                          use_hash_prefix,
+                          object_sizes,
+                          compressible_fraction};
+      window.acquire();
+      publisher.Publish(format_range(std::move(r)))
+          .then([&window](auto f) { window.release(f.get().status()); });
+      if (++published % report_every == 0) std::cout << '.' << std::flush;
+    }
   };
-  std::vector<google::cloud::future<google::cloud::Status>> pending_publish;
 
   std::cout << "Generating work items" << std::flush;
-  auto next_report = object_count / 10;
-  for (long offset = 0; offset < object_count; offset += task_size) {
-    if (offset >= next_report) {
-      std::cout << '.' << std::flush;
-      next_report += object_count / 10;
-    }
-    auto prefix = make_prefix(offset);
-    auto const task_objects_count =
-        (std::min)(task_size, object_count - offset);
-    pending_publish.push_back(
-        publisher
-            .Publish(format_work_item(
-                work_item{bucket, prefix, task_objects_count, use_hash_prefix}))
-            .then([](auto f) { return f.get().status(); }));
+  std::vector<std::future<void>> tasks(static_cast<std::size_t>(concurrency));
+  for (std::size_t i = 0; i != tasks.size(); ++i) {
+    auto const begin = item_count * static_cast<long>(i) / concurrency;
+    auto const end = item_count * static_cast<long>(i + 1) / concurrency;
+    tasks[i] = std::async(std::launch::async, generator, begin, end);
   }
+  // The callbacks reference local variables, wait for all the publish calls
+  // before reporting any errors from the generators.
+  for (auto& t : tasks) t.wait();
+  publisher.Flush();
+  auto const error_count = window.wait();
+  for (auto& t : tasks) t.get();
   std::cout << "DONE" << std::endl;
-  std::map<google::cloud::StatusCode, std::int64_t> error_count;
-  for (auto& f : pending_publish) {
-    auto const code = f.get().code();
-    if (code == google::cloud::StatusCode::kOk) continue;
-    ++error_count[code];
-  }
+
   if (error_count.empty()) return;
   std::cerr << "Errors publishing messages: ";
   std::int64_t total_count = 0;
@@ -254,13 +646,251 @@ std::string create_contents(work_item const& wi, long index) {
   return std::move(os).str();
 }
 
-void process_one_item(gcs::Client client, pubsub::Message const& m) {
-  auto wi = parse_message(m);
-  for (std::int64_t i = 0; i != wi.object_count; ++i) {
-    auto object_name = wi.prefix + "/object-" + std::to_string(i);
-    auto hashed = hashed_name(wi.use_hash_prefix, std::move(object_name));
-    client.InsertObject(wi.bucket, hashed, create_contents(wi, i)).value();
+/// Format a latency in milliseconds, with microsecond precision.
+std::string format_ms(std::chrono::microseconds us) {
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.3f",
+                static_cast<double>(us.count()) / 1000.0);
+  return buf;
+}
+
+/**
+ * Objects larger than this are streamed, instead of inserted with a single
+ * request.
+ *
+ * Each insert in flight holds at most this much of its object in memory, with
+ * the default `--concurrency` and `--insert-concurrency` a worker holds at most
+ * 128 of them. This is also the upload buffer size of the clients, see
+ * `insert_client_options()`, otherwise each stream would buffer up to 8MiB.
+ */
+auto constexpr kMaxInsertSize = std::int64_t{256} * 1024;
+
+/**
+ * The contents of an object.
+ *
+ * The contents start with a description of the object. The payload, if any,
+ * fills the object up to its sampled size.
+ */
+struct object_contents {
+  std::string header;
+  std::uint64_t key;
+  std::int64_t payload_size;
+
+  std::int64_t size() const {
+    return static_cast<std::int64_t>(header.size()) + payload_size;
+  }
+};
+
+object_contents make_contents(work_item const& wi, std::string const& name,
+                              std::int64_t index) {
+  auto header = create_contents(wi, index);
+  auto const key = mix_bits(crc32c::Crc32c(name));
+  auto const payload_size = (std::max)(
+      std::int64_t{0}, wi.object_sizes->sample(key) -
+                           static_cast<std::int64_t>(header.size()));
+  return object_contents{std::move(header), key, payload_size};
+}
+
+/// Create the object at @p index in a work item, @p names must be reset to
+/// the work item prefix.
+google::cloud::Status create_object(gcs::Client const& client,
+                                    cpp_samples::object_name_generator& names,
+                                    work_item const& wi, std::int64_t index) {
+  auto const& hashed = names.name(index);
+  auto c = make_contents(wi, hashed, index);
+  auto const& payload = payload_generator::instance();
+  if (c.size() <= kMaxInsertSize) {
+    auto contents = std::move(c.header);
+    contents.reserve(contents.size() + c.payload_size);
+    payload.write(c.key, c.payload_size, wi.compressible_fraction,
+                  [&](char const* data, std::size_t n) {
+                    contents.append(data, n);
+                  });
+    return client.InsertObject(wi.bucket, hashed, std::move(contents))
+        .status();
+  }
+  auto os = client.WriteObject(wi.bucket, hashed);
+  os << c.header;
+  payload.write(c.key, c.payload_size, wi.compressible_fraction,
+                [&](char const* data, std::size_t n) {
+                  os.write(data, static_cast<std::streamsize>(n));
+                });
+  os.Close();
+  return os.metadata().status();
+}
+
+/// The options for a client used in `create_object()`, with a connection for
+/// each of @p inserts in flight.
+gcs::ClientOptions insert_client_options(std::size_t inserts) {
+  auto options = gcs::ClientOptions::CreateDefaultClientOptions().value();
+  options.set_connection_pool_size(inserts);
+  options.set_upload_buffer_size(static_cast<std::size_t>(kMaxInsertSize));
+  return options;
+}
+
+/**
+ * The statistics for one reporting interval of the worker.
+ *
+ * The worker disables the client library retry loop, and retries the inserts
+ * itself, so each retry and each error code is counted.
+ */
+struct worker_stats {
+  cpp_samples::latency_histogram work_item_latency;
+  cpp_samples::latency_histogram insert_latency;
+  std::atomic<std::int64_t> work_items{0};
+  std::atomic<std::int64_t> failed_work_items{0};
+  std::atomic<std::int64_t> splits{0};
+  std::atomic<std::int64_t> delivery_attempts{0};
+  std::atomic<std::int64_t> objects{0};
+  std::atomic<std::int64_t> retries{0};
+  // Indexed by status code.
+  std::array<std::atomic<std::int64_t>, 32> errors{};
+};
+
+void print_json_latency(std::ostream& os, char const* name,
+                        cpp_samples::latency_histogram::snapshot const& s) {
+  os << ",\"" << name << "\":{\"count\":" << s.count()
+     << ",\"p50\":" << format_ms(s.percentile(50))
+     << ",\"p90\":" << format_ms(s.percentile(90))
+     << ",\"p99\":" << format_ms(s.percentile(99))
+     << ",\"p999\":" << format_ms(s.percentile(99.9))
+     << ",\"max\":" << format_ms(s.max()) << "}";
+}
+
+/// Print the statistics since the last call as a JSON line, and reset them.
+void report_stats(std::ostream& os, worker_stats& stats,
+                  std::string const& worker_id,
+                  std::chrono::steady_clock::duration interval) {
+  auto const seconds = std::chrono::duration<double>(interval).count();
+  auto const work_items = stats.work_items.exchange(0);
+  auto const objects = stats.objects.exchange(0);
+  auto const attempts = stats.delivery_attempts.exchange(0);
+  os << "{\"worker\":\"" << worker_id << "\",\"interval_s\":" << seconds
+     << ",\"work_items\":" << work_items
+     << ",\"failed_work_items\":" << stats.failed_work_items.exchange(0)
+     << ",\"splits\":" << stats.splits.exchange(0)
+     << ",\"mean_delivery_attempts\":"
+     << (work_items == 0 ? 0.0
+                         : static_cast<double>(attempts) /
+                               static_cast<double>(work_items))
+     << ",\"objects\":" << objects
+     << ",\"objects_per_s\":" << static_cast<double>(objects) / seconds
+     << ",\"retries\":" << stats.retries.exchange(0) << ",\"errors\":{";
+  char const* separator = "";
+  for (std::size_t code = 0; code != stats.errors.size(); ++code) {
+    auto const count = stats.errors[code].exchange(0);
+    if (count == 0) continue;
+    os << separator << "\""
+       << google::cloud::StatusCodeToString(
+              static_cast<google::cloud::StatusCode>(code))
+       << "\":" << count;
+    separator = ",";
+  }
+  os << "}";
+  print_json_latency(os, "work_item_latency_ms",
+                     stats.work_item_latency.collect());
+  print_json_latency(os, "insert_latency_ms", stats.insert_latency.collect());
+  os << "}" << std::endl;
+}
+
+bool is_transient(google::cloud::StatusCode code) {
+  using google::cloud::StatusCode;
+  return code == StatusCode::kUnavailable or
+         code == StatusCode::kResourceExhausted or
+         code == StatusCode::kDeadlineExceeded or
+         code == StatusCode::kInternal;
+}
+
+/// Create an object, retrying transient errors with a truncated exponential
+/// backoff.
+void create_object_with_retry(gcs::Client const& client,
+                              cpp_samples::object_name_generator& names,
+                              work_item const& wi, std::int64_t index,
+                              worker_stats& stats) {
+  auto constexpr kMaxAttempts = 8;
+  auto constexpr kMaximumBackoff = std::chrono::milliseconds(10'000);
+  thread_local auto gen = cpp_samples::fast_random(random_seed());
+  auto backoff = std::chrono::milliseconds(100);
+  for (int attempt = 1;; ++attempt) {
+    auto const start = std::chrono::steady_clock::now();
+    auto status = create_object(client, names, wi, index);
+    stats.insert_latency.record(std::chrono::steady_clock::now() - start);
+    if (status.ok()) return;
+    auto const code = static_cast<std::size_t>(status.code());
+    ++stats.errors[(std::min)(code, stats.errors.size() - 1)];
+    if (attempt == kMaxAttempts or not is_transient(status.code())) {
+      throw google::cloud::RuntimeStatusError(std::move(status));
+    }
+    ++stats.retries;
+    // Sleep for a random time in [backoff / 2, backoff].
+    auto const jitter = std::uniform_int_distribution<std::int64_t>(
+        backoff.count() / 2, backoff.count())(gen);
+    std::this_thread::sleep_for(std::chrono::milliseconds(jitter));
+    backoff = (std::min)(backoff * 2, kMaximumBackoff);
+  }
+}
+
+/// Create all the objects in a range, with up to @p insert_concurrency
+/// inserts in flight. Returns the number of objects created.
+std::int64_t process_range(gcs::Client const& client, work_range const& r,
+                           int insert_concurrency, worker_stats& stats) {
+  if (r.count <= 0) return 0;
+  auto const first_group = r.start / r.task_size;
+  auto const last_group = (r.start + r.count - 1) / r.task_size;
+  std::vector<work_item> groups;
+  for (auto g = first_group; g <= last_group; ++g) {
+    groups.push_back(group_item(r, g));
+  }
+
+  // The Cloud Storage client library has no asynchronous insert, each insert
+  // in flight needs its own thread. All the threads share the client, and
+  // therefore its connection pool.
+  auto const end = r.start + r.count;
+  std::atomic<std::int64_t> next{r.start};
+  auto inserter = [&] {
+    cpp_samples::object_name_generator names;
+    std::int64_t current = -1;
+    for (auto i = next++; i < end; i = next++) {
+      auto const group = i / r.task_size;
+      auto const& wi = groups[group - first_group];
+      if (group != current) names.reset(wi.prefix, wi.use_hash_prefix);
+      current = group;
+      create_object_with_retry(client, names, wi, i % r.task_size, stats);
+      ++stats.objects;
+    }
+  };
+  auto const threads = static_cast<std::int64_t>(
+      (std::max)(1, (std::min)(insert_concurrency, 1024)));
+  std::vector<std::future<void>> tasks(
+      static_cast<std::size_t>((std::min)(threads, r.count)));
+  for (auto& t : tasks) t = std::async(std::launch::async, inserter);
+  // Wait for all the inserts before reporting the first error, if any.
+  for (auto& t : tasks) t.wait();
+  for (auto& t : tasks) t.get();
+  return r.count;
+}
+
+/// Split a range into up to @p fanout sub-ranges, and publish them.
+google::cloud::Status split_range(pubsub::Publisher& publisher,
+                                  work_range const& r, int fanout) {
+  // Each sub-range contains complete groups, so they can be split further.
+  auto const groups = (r.count + r.task_size - 1) / r.task_size;
+  auto const sub_range_groups = (groups + fanout - 1) / fanout;
+  auto const size = sub_range_groups * r.task_size;
+  std::vector<google::cloud::future<google::cloud::Status>> pending;
+  for (std::int64_t offset = 0; offset < r.count; offset += size) {
+    auto sub = r;
+    sub.start = r.start + offset;
+    sub.count = (std::min)(size, r.count - offset);
+    pending.push_back(publisher.Publish(format_range(std::move(sub)))
+                          .then([](auto f) { return f.get().status(); }));
+  }
+  google::cloud::Status status;
+  for (auto& f : pending) {
+    auto s = f.get();
+    if (status.ok()) status = std::move(s);
   }
+  return status;
 }
 
 /// Run the worker thread for a GKE batch job.
@@ -273,13 +903,23 @@ void worker(boost::program_options::variables_map const& vm) {
   if (vm.count("subscription") == 0) {
     throw std::runtime_error("the `schedule` action requires --subscription");
   }
+  // The `schedule` action publishes ranges much larger than a task. Creating
+  // one in a single callback outlasts the message lease, and the range is
+  // redelivered to another worker while it is still being created. The
+  // workers must split such ranges, and they need a topic for the sub-ranges.
+  if (vm.count("topic") == 0) {
+    throw std::runtime_error("the `worker` action requires --topic");
+  }
   auto const concurrency = vm["concurrency"].as<int>();
+  auto const insert_concurrency = vm["insert-concurrency"].as<int>();
+  auto const split_fanout = (std::max)(2, vm["split-fanout"].as<int>());
   auto const project_id = vm["project"].as<std::string>();
   auto const subscription_id = vm["subscription"].as<std::string>();
 
+  auto publisher = pubsub::Publisher(pubsub::MakePublisherConnection(
+      pubsub::Topic(project_id, vm["topic"].as<std::string>()), {}));
+
   using namespace std::chrono_literals;
-  using std::chrono::duration_cast;
-  using std::chrono::milliseconds;
   auto const subscription = pubsub::Subscription(project_id, subscription_id);
   auto subscriber = pubsub::Subscriber(pubsub::MakeSubscriberConnection(
       subscription,
@@ -291,35 +931,48 @@ void worker(boost::program_options::variables_map const& vm) {
       pubsub::ConnectionOptions{}.set_background_thread_pool_size(
           concurrency)));
 
-  std::atomic<std::int64_t> latency{0};
-  std::atomic<std::int64_t> attempts{0};
-  std::atomic<std::int64_t> counter{0};
-  auto handler = [&, cl = gcs::Client::CreateDefaultClient().value()](
+  worker_stats stats;
+  // Size the connection pool for all the inserts in flight. The worker
+  // retries failed inserts itself, see `create_object_with_retry()`.
+  auto handler = [&, cl = gcs::Client(
+                         insert_client_options(
+                             static_cast<std::size_t>(concurrency) *
+                             insert_concurrency),
+                         gcs::LimitedErrorCountRetryPolicy(0))](
                      pubsub::Message const& m, pubsub::AckHandler h) {
     auto const start = std::chrono::steady_clock::now();
-    process_one_item(cl, m);
-    auto const elapsed = std::chrono::steady_clock::now() - start;
-    latency.fetch_add(duration_cast<milliseconds>(elapsed).count());
-    attempts.fetch_add(h.delivery_attempt());
-    ++counter;
+    stats.delivery_attempts += h.delivery_attempt();
+    try {
+      auto const range = parse_range(m);
+      if (range.count > range.task_size) {
+        auto status = split_range(publisher, range, split_fanout);
+        if (not status.ok()) {
+          throw google::cloud::RuntimeStatusError(std::move(status));
+        }
+        ++stats.splits;
+      } else {
+        process_range(cl, range, insert_concurrency, stats);
+      }
+    } catch (std::exception const& ex) {
+      std::cerr << "Error processing work item: " << ex.what() << std::endl;
+      ++stats.failed_work_items;
+      std::move(h).nack();
+      return;
+    }
+    stats.work_item_latency.record(std::chrono::steady_clock::now() - start);
+    ++stats.work_items;
     std::move(h).ack();
   };
 
-  using namespace std::chrono_literals;
-  using google::cloud::StatusCode;
+  // In GKE the host name is the pod name.
+  auto const worker_id = getenv_or_empty("HOSTNAME");
   auto session = subscriber.Subscribe(handler);
-  auto total = counter.exchange(0);
-  auto mean = [&total](std::int64_t v) -> std::int64_t {
-    if (total == 0) return 0;
-    return v / total;
-  };
-  while (session.wait_for(30s) == std::future_status::timeout) {
-    auto last = counter.exchange(0);
-    total += last;
-    std::cout << "Processed " << last << " work items"
-              << ", latency=" << mean(latency.load())
-              << ", attempts=" << mean(attempts.load()) << ", count=" << total
-              << std::endl;
+  auto constexpr kReportInterval = 30s;
+  auto last_report = std::chrono::steady_clock::now();
+  while (session.wait_for(kReportInterval) == std::future_status::timeout) {
+    auto const now = std::chrono::steady_clock::now();
+    report_stats(std::cout, stats, worker_id, now - last_report);
+    last_report = now;
   }
 
   auto status = session.get();
@@ -330,4 +983,685 @@ void worker(boost::program_options::variables_map const& vm) {
   throw std::runtime_error(std::move(os).str());
 }
 
+/// The work items owned by one thread in the `local` action.
+struct work_queue {
+  std::mutex mu;
+  std::deque<work_item> items;
+};
+
+/// Take the next work item for thread @p id, stealing from other threads once
+/// its own queue is empty.
+std::optional<work_item> next_work_item(std::vector<work_queue>& queues,
+                                        std::size_t id) {
+  // The owner takes from the back and thieves take from the front, so they
+  // only compete for the last item in a queue.
+  {
+    auto& q = queues[id];
+    std::lock_guard<std::mutex> lk(q.mu);
+    if (not q.items.empty()) {
+      auto wi = std::move(q.items.back());
+      q.items.pop_back();
+      return wi;
+    }
+  }
+  for (std::size_t i = 1; i != queues.size(); ++i) {
+    auto& q = queues[(id + i) % queues.size()];
+    std::lock_guard<std::mutex> lk(q.mu);
+    if (q.items.empty()) continue;
+    auto wi = std::move(q.items.front());
+    q.items.pop_front();
+    return wi;
+  }
+  // No work items are added once the threads start, all the queues are empty.
+  return std::nullopt;
+}
+
+/// Populate the bucket from this process, without a task queue.
+void local(boost::program_options::variables_map const& vm) {
+  std::cout << "Populating bucket from local threads" << std::endl;
+
+  if (vm.count("bucket") == 0) {
+    throw std::runtime_error("the `local` action requires --bucket");
+  }
+  auto const bucket = vm["bucket"].as<std::string>();
+  auto const object_count = vm["object-count"].as<long>();
+  auto const use_hash_prefix = vm["use-hash-prefix"].as<bool>();
+  auto const task_size = (std::max)(1L, vm["task-size"].as<long>());
+  auto const concurrency = (std::max)(1, vm["concurrency"].as<int>());
+
+  // Deal the work items round-robin across the threads. Threads that finish
+  // early steal from the others, which evens out slow inserts.
+  std::vector<work_queue> queues(static_cast<std::size_t>(concurrency));
+  auto const range = work_range{
+      bucket,
+      job_seed(vm),
+      0,
+      object_count,
+      task_size,
+      use_hash_prefix,
+      std::make_shared<size_distribution const>(
+          vm["object-size-distribution"].as<std::string>()),
+      vm["compressible-fraction"].as<double>()};
+  std::size_t n = 0;
+  for (long offset = 0; offset < object_count; offset += task_size) {
+    auto wi = group_item(range, offset / task_size);
+    wi.object_count = (std::min)(task_size, object_count - offset);
+    queues[n++ % queues.size()].items.push_back(std::move(wi));
+  }
+
+  auto const client = gcs::Client(insert_client_options(queues.size()));
+
+  std::atomic<std::int64_t> objects{0};
+  std::atomic<bool> failed{false};
+  auto runner = [&](std::size_t id) {
+    try {
+      cpp_samples::object_name_generator names;
+      for (auto wi = next_work_item(queues, id); wi and not failed;
+           wi = next_work_item(queues, id)) {
+        names.reset(wi->prefix, wi->use_hash_prefix);
+        for (std::int64_t i = 0; i != wi->object_count; ++i) {
+          auto status = create_object(client, names, *wi, i);
+          if (not status.ok()) {
+            throw google::cloud::RuntimeStatusError(std::move(status));
+          }
+          ++objects;
+        }
+      }
+    } catch (...) {
+      // Stop the other threads, the first error is reported below.
+      failed = true;
+      throw;
+    }
+  };
+
+  using namespace std::chrono_literals;
+  auto const start = std::chrono::steady_clock::now();
+  std::vector<std::future<void>> tasks(queues.size());
+  for (std::size_t id = 0; id != tasks.size(); ++id) {
+    tasks[id] = std::async(std::launch::async, runner, id);
+  }
+  auto constexpr kReportInterval = 10s;
+  std::int64_t last = 0;
+  for (auto& t : tasks) {
+    while (t.wait_for(kReportInterval) == std::future_status::timeout) {
+      auto const current = objects.load();
+      std::cout << "Created " << current << " objects, objects/s="
+                << (current - last) /
+                       std::chrono::seconds(kReportInterval).count()
+                << std::endl;
+      last = current;
+    }
+  }
+  for (auto& t : tasks) t.get();
+
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+  auto const elapsed = (std::max)(
+      duration_cast<milliseconds>(std::chrono::steady_clock::now() - start),
+      milliseconds(1));
+  std::cout << "Created " << objects.load() << " objects in "
+            << elapsed.count() << "ms, objects/s="
+            << objects.load() * 1000 / elapsed.count() << std::endl;
+}
+
+/// Print the percentiles of the latencies in @p s.
+void print_latency(std::ostream& os, char const* name,
+                   cpp_samples::latency_histogram::snapshot const& s) {
+  os << ", " << name << "_p50_ms=" << format_ms(s.percentile(50)) << ", "
+     << name << "_p90_ms=" << format_ms(s.percentile(90)) << ", " << name
+     << "_p99_ms=" << format_ms(s.percentile(99)) << ", " << name
+     << "_max_ms=" << format_ms(s.max());
+}
+
+/**
+ * Create objects at a target rate, and report the latency every second.
+ *
+ * This is an open-loop load generator: the requests arrive as a Poisson
+ * process, independent of how fast the previous requests complete. The rate
+ * increases linearly during the ramp-up period. The latency of each request is
+ * measured from its scheduled arrival, and includes any time waiting for a
+ * thread, while the service latency only includes the insert itself.
+ */
+void load(boost::program_options::variables_map const& vm) {
+  std::cout << "Creating objects at a target rate" << std::endl;
+
+  if (vm.count("bucket") == 0) {
+    throw std::runtime_error("the `load` action requires --bucket");
+  }
+  auto const target_rate = vm["target-rate"].as<double>();
+  if (target_rate <= 0) {
+    throw std::runtime_error("the `load` action requires a positive rate");
+  }
+  using clock = std::chrono::steady_clock;
+  using std::chrono::duration;
+  using std::chrono::seconds;
+  auto const ramp_up = seconds(vm["ramp-up"].as<int>());
+  auto const test_duration = seconds(vm["duration"].as<int>());
+  auto const concurrency = (std::max)(1, vm["concurrency"].as<int>());
+  auto const range =
+      work_range{vm["bucket"].as<std::string>(),
+                 random_seed(),
+                 0,
+                 (std::numeric_limits<std::int64_t>::max)(),
+                 (std::max)(1L, vm["task-size"].as<long>()),
+                 vm["use-hash-prefix"].as<bool>(),
+                 std::make_shared<size_distribution const>(
+                     vm["object-size-distribution"].as<std::string>()),
+                 vm["compressible-fraction"].as<double>()};
+
+  struct request {
+    std::int64_t index;
+    clock::time_point scheduled;
+  };
+  std::mutex mu;
+  std::condition_variable cv;
+  std::deque<request> requests;
+  bool done = false;
+
+  cpp_samples::latency_histogram latency;
+  cpp_samples::latency_histogram service_latency;
+  std::atomic<std::int64_t> errors{0};
+
+  auto const client =
+      gcs::Client(insert_client_options(static_cast<std::size_t>(concurrency)));
+  auto runner = [&] {
+    cpp_samples::object_name_generator names;
+    work_item wi;
+    std::int64_t current = -1;
+    for (;;) {
+      std::unique_lock<std::mutex> lk(mu);
+      cv.wait(lk, [&] { return done or not requests.empty(); });
+      if (requests.empty()) return;
+      auto const r = requests.front();
+      requests.pop_front();
+      lk.unlock();
+
+      auto const group = r.index / range.task_size;
+      if (group != current) {
+        wi = group_item(range, group);
+        names.reset(wi.prefix, wi.use_hash_prefix);
+        current = group;
+      }
+      auto const start = clock::now();
+      auto status =
+          create_object(client, names, wi, r.index % range.task_size);
+      if (not status.ok()) ++errors;
+      auto const end = clock::now();
+      service_latency.record(end - start);
+      latency.record(end - r.scheduled);
+    }
+  };
+  std::vector<std::thread> threads(static_cast<std::size_t>(concurrency));
+  for (auto& t : threads) t = std::thread(runner);
+
+  auto const start = clock::now();
+  auto rate_at = [&](clock::time_point tp) {
+    if (tp - start >= ramp_up) return target_rate;
+    // Start at 1% of the target, otherwise the first arrival is delayed by the
+    // (very long) inter-arrival time at a rate close to 0.
+    auto const fraction = duration<double>(tp - start) / ramp_up;
+    return target_rate * (std::max)(0.01, fraction);
+  };
+  auto gen = cpp_samples::fast_random(random_seed());
+  auto next = start;
+  auto next_report = start + seconds(1);
+  std::int64_t index = 0;
+  std::int64_t last_completed = 0;
+  while (next < start + test_duration) {
+    std::this_thread::sleep_until((std::min)(next, next_report));
+    auto const now = clock::now();
+    if (now >= next_report) {
+      auto const l = latency.collect();
+      auto const s = service_latency.collect();
+      std::size_t backlog;
+      {
+        std::lock_guard<std::mutex> lk(mu);
+        backlog = requests.size();
+      }
+      std::cout << "t=" << duration<double>(now - start).count()
+                << ", target_rate=" << rate_at(now)
+                << ", completed=" << l.count() << ", backlog=" << backlog
+                << ", errors=" << errors.exchange(0);
+      print_latency(std::cout, "latency", l);
+      print_latency(std::cout, "service", s);
+      std::cout << std::endl;
+      last_completed += l.count();
+      next_report += seconds(1);
+      continue;
+    }
+    // Enqueue all the requests that are due.
+    {
+      std::lock_guard<std::mutex> lk(mu);
+      for (; next <= now; ++index) {
+        requests.push_back(request{index, next});
+        auto const interval =
+            std::exponential_distribution<double>(rate_at(next))(gen);
+        next += std::chrono::duration_cast<clock::duration>(
+            duration<double>(interval));
+      }
+    }
+    cv.notify_all();
+  }
+  {
+    std::lock_guard<std::mutex> lk(mu);
+    done = true;
+  }
+  cv.notify_all();
+  for (auto& t : threads) t.join();
+
+  auto const l = latency.collect();
+  std::cout << "Scheduled " << index << " requests, completed "
+            << last_completed + l.count() << std::endl;
+}
+
+/// A bounded queue, with multiple producers and consumers.
+template <typename T>
+class bounded_queue {
+ public:
+  explicit bounded_queue(std::size_t capacity) : capacity_(capacity) {}
+
+  /// Add an element, blocking while the queue is full.
+  void push(T value) {
+    std::unique_lock<std::mutex> lk(mu_);
+    not_full_.wait(lk, [this] { return items_.size() < capacity_; });
+    items_.push_back(std::move(value));
+    not_empty_.notify_one();
+  }
+
+  /// Remove an element, returns an empty optional once the queue is closed
+  /// and drained.
+  std::optional<T> pop() {
+    std::unique_lock<std::mutex> lk(mu_);
+    not_empty_.wait(lk, [this] { return closed_ or not items_.empty(); });
+    if (items_.empty()) return std::nullopt;
+    auto value = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return value;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lk(mu_);
+    closed_ = true;
+    not_empty_.notify_all();
+  }
+
+ private:
+  std::size_t const capacity_;
+  std::mutex mu_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+  std::deque<T> items_;
+  bool closed_ = false;
+};
+
+/**
+ * The key ranges used to list a bucket in parallel.
+ *
+ * With `--use-hash-prefix` the object names start with 8 hex digits, so
+ * splitting the key space by the first two characters creates 256 shards of
+ * similar size. The first and last shards are unbounded, so all the names are
+ * covered, objects without a hash prefix are listed by the last shard.
+ */
+std::vector<std::pair<std::string, std::string>> listing_shards() {
+  auto hex = [](int i) {
+    char buf[8];
+    std::snprintf(buf, sizeof(buf), "%02x", i);
+    return std::string(buf);
+  };
+  std::vector<std::pair<std::string, std::string>> shards;
+  for (int i = 0; i != 256; ++i) {
+    shards.emplace_back(i == 0 ? std::string{} : hex(i),
+                        i == 255 ? std::string{} : hex(i + 1));
+  }
+  return shards;
+}
+
+/// List the objects in one shard, an empty bound leaves that side open.
+gcs::ListObjectsReader list_shard(gcs::Client const& client,
+                                  std::string const& bucket,
+                                  std::pair<std::string, std::string> const& s,
+                                  std::string const& fields) {
+  auto start = s.first.empty() ? gcs::StartOffset() : gcs::StartOffset(s.first);
+  auto end = s.second.empty() ? gcs::EndOffset() : gcs::EndOffset(s.second);
+  return client.ListObjects(bucket, std::move(start), std::move(end),
+                            gcs::Fields(fields));
+}
+
+/**
+ * Parse the offset and index from an object name.
+ *
+ * The names are `[hash_]name-<random>-offset-<hex offset>/object-<index>`,
+ * where the optional hash is the `crc32c` of the rest of the name, as 8 hex
+ * digits, and the random part is 32 characters from `[a-z0-9]`, see
+ * `random_prefix()` and `object_name_generator`. Returns false if @p name
+ * does not match this scheme in full.
+ */
+bool parse_object_name(std::string const& name, std::int64_t& offset,
+                       std::int64_t& index) {
+  auto constexpr kHashSize = std::size_t{9};
+  auto constexpr kRandomSize = std::size_t{32};
+  auto is_hex = [](char c) {
+    return (c >= '0' and c <= '9') or (c >= 'a' and c <= 'f');
+  };
+  auto is_digit = [](char c) { return c >= '0' and c <= '9'; };
+  auto is_alnum = [](char c) {
+    return (c >= 'a' and c <= 'z') or (c >= '0' and c <= '9');
+  };
+  auto pos = std::size_t{0};
+  // Consume @p literal at `pos`.
+  auto literal = [&](std::string const& literal) {
+    if (name.compare(pos, literal.size(), literal) != 0) return false;
+    pos += literal.size();
+    return true;
+  };
+  // Consume between @p min and @p max characters matching @p pred at `pos`.
+  auto run = [&](auto pred, std::size_t min, std::size_t max) {
+    auto const start = pos;
+    while (pos != name.size() and pos - start != max and pred(name[pos])) {
+      ++pos;
+    }
+    return pos - start >= min;
+  };
+
+  auto const hashed =
+      name.size() > kHashSize and name[kHashSize - 1] == '_' and
+      std::all_of(name.begin(), name.begin() + kHashSize - 1, is_hex);
+  if (hashed) pos = kHashSize;
+  if (not literal("name-") or not run(is_alnum, kRandomSize, kRandomSize) or
+      not literal("-offset-")) {
+    return false;
+  }
+  auto const offset_start = pos;
+  if (not run(is_hex, 8, 16)) return false;
+  auto const offset_end = pos;
+  if (not literal("/object-")) return false;
+  auto const index_start = pos;
+  // Larger indices do not fit in `std::int64_t`, and are never created.
+  if (not run(is_digit, 1, 18) or pos != name.size()) return false;
+
+  if (hashed) {
+    char buf[16];
+    std::snprintf(buf, sizeof(buf), "%08x",
+                  crc32c::Crc32c(name.data() + kHashSize,
+                                 name.size() - kHashSize));
+    if (name.compare(0, kHashSize - 1, buf) != 0) return false;
+  }
+  offset = static_cast<std::int64_t>(
+      std::stoull(name.substr(offset_start, offset_end - offset_start),
+                  nullptr, 16));
+  index = std::stoll(name.substr(index_start));
+  return true;
+}
+
+/// Returns true if @p name was created by this program.
+bool is_populated_name(std::string const& name) {
+  std::int64_t offset;
+  std::int64_t index;
+  return parse_object_name(name, offset, index);
+}
+
+/// Wait for @p tasks, calling @p report periodically.
+template <typename Report>
+void wait_with_reports(std::vector<std::future<void>>& tasks,
+                       Report&& report) {
+  using namespace std::chrono_literals;
+  for (auto& t : tasks) {
+    while (t.wait_for(10s) == std::future_status::timeout) report();
+  }
+}
+
+/**
+ * Delete the objects created by this program.
+ *
+ * The bucket is listed in parallel shards, and the listed objects are deleted
+ * by a pool of threads. A bounded queue between the two stages limits the
+ * memory usage when the listing is faster than the deletes. Only the objects
+ * with names generated by this program are deleted.
+ */
+void cleanup(boost::program_options::variables_map const& vm) {
+  std::cout << "Deleting the objects created by this program" << std::endl;
+
+  if (vm.count("bucket") == 0) {
+    throw std::runtime_error("the `cleanup` action requires --bucket");
+  }
+  auto const bucket = vm["bucket"].as<std::string>();
+  auto const concurrency = (std::max)(1, vm["concurrency"].as<int>());
+  auto const list_concurrency = (std::max)(1, vm["list-concurrency"].as<int>());
+
+  auto client_options =
+      gcs::ClientOptions::CreateDefaultClientOptions().value();
+  client_options.set_connection_pool_size(
+      static_cast<std::size_t>(concurrency + list_concurrency));
+  auto const client = gcs::Client(std::move(client_options));
+
+  auto const shards = listing_shards();
+  std::atomic<std::size_t> next_shard{0};
+  bounded_queue<std::pair<std::string, std::int64_t>> queue(
+      static_cast<std::size_t>(concurrency) * 64);
+  std::atomic<std::int64_t> listed{0};
+  std::atomic<std::int64_t> skipped{0};
+  std::atomic<std::int64_t> deleted{0};
+  std::atomic<std::int64_t> errors{0};
+
+  auto lister = [&] {
+    for (auto i = next_shard++; i < shards.size(); i = next_shard++) {
+      for (auto& o : list_shard(client, bucket, shards[i],
+                                "items(name,generation),nextPageToken")) {
+        if (not o) throw google::cloud::RuntimeStatusError(o.status());
+        if (not is_populated_name(o->name())) {
+          ++skipped;
+          continue;
+        }
+        ++listed;
+        queue.push({o->name(), o->generation()});
+      }
+    }
+  };
+  auto deleter = [&] {
+    for (auto o = queue.pop(); o; o = queue.pop()) {
+      auto status =
+          client.DeleteObject(bucket, o->first, gcs::Generation(o->second));
+      // Another process may have deleted the object already.
+      if (status.ok() or
+          status.code() == google::cloud::StatusCode::kNotFound) {
+        ++deleted;
+        continue;
+      }
+      if (errors++ == 0) {
+        std::cerr << "Error deleting object: " << status << std::endl;
+      }
+    }
+  };
+
+  auto const start = std::chrono::steady_clock::now();
+  std::int64_t last = 0;
+  auto report = [&] {
+    auto const current = deleted.load();
+    std::cout << "Listed " << listed.load() << " objects, deleted " << current
+              << ", deletes/s=" << (current - last) / 10
+              << ", errors=" << errors.load() << std::endl;
+    last = current;
+  };
+  std::vector<std::future<void>> deleters(
+      static_cast<std::size_t>(concurrency));
+  for (auto& t : deleters) t = std::async(std::launch::async, deleter);
+  std::vector<std::future<void>> listers(
+      static_cast<std::size_t>(list_concurrency));
+  for (auto& t : listers) t = std::async(std::launch::async, lister);
+  wait_with_reports(listers, report);
+  // The deleters exit once the queue is drained.
+  queue.close();
+  wait_with_reports(deleters, report);
+  for (auto& t : listers) t.get();
+
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+  auto const elapsed = (std::max)(
+      duration_cast<milliseconds>(std::chrono::steady_clock::now() - start),
+      milliseconds(1));
+  std::cout << "Deleted " << deleted.load() << " objects in "
+            << elapsed.count() << "ms, deletes/s="
+            << deleted.load() * 1000 / elapsed.count()
+            << ", skipped=" << skipped.load() << std::endl;
+  if (errors.load() != 0) {
+    throw std::runtime_error("Errors deleting objects, count=" +
+                             std::to_string(errors.load()));
+  }
+}
+
+/// Format a CRC32C checksum as it appears in the object metadata: the base64
+/// encoding of the big-endian value.
+std::string format_crc32c(std::uint32_t crc) {
+  char const alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  unsigned char const bytes[] = {static_cast<unsigned char>(crc >> 24),
+                                 static_cast<unsigned char>(crc >> 16),
+                                 static_cast<unsigned char>(crc >> 8),
+                                 static_cast<unsigned char>(crc)};
+  std::string result;
+  result.push_back(alphabet[bytes[0] >> 2]);
+  result.push_back(alphabet[(bytes[0] & 0x03) << 4 | bytes[1] >> 4]);
+  result.push_back(alphabet[(bytes[1] & 0x0f) << 2 | bytes[2] >> 6]);
+  result.push_back(alphabet[bytes[2] & 0x3f]);
+  result.push_back(alphabet[bytes[3] >> 2]);
+  result.push_back(alphabet[(bytes[3] & 0x03) << 4]);
+  result.append("==");
+  return result;
+}
+
+/// Compute the CRC32C checksum of an object, without creating its contents.
+std::uint32_t expected_crc32c(work_item const& wi, object_contents const& c) {
+  auto crc = crc32c::Crc32c(c.header);
+  payload_generator::instance().write(
+      c.key, c.payload_size, wi.compressible_fraction,
+      [&](char const* data, std::size_t n) {
+        crc = crc32c::Extend(crc, reinterpret_cast<std::uint8_t const*>(data),
+                             n);
+      });
+  return crc;
+}
+
+/**
+ * Verify the objects created by a job.
+ *
+ * The action must use the same `--seed`, `--object-count`, `--task-size`,
+ * `--use-hash-prefix`, `--object-size-distribution` and
+ * `--compressible-fraction` values as the job. The bucket is listed in
+ * parallel shards, and each listed object is mapped back to its index from
+ * its name. The expected name, size, and CRC32C checksum are computed locally
+ * and compared with the object metadata, so no objects are downloaded. A
+ * bitmap records the objects found, to count the missing objects.
+ */
+void verify(boost::program_options::variables_map const& vm) {
+  std::cout << "Verifying the objects created by a job" << std::endl;
+
+  if (vm.count("bucket") == 0) {
+    throw std::runtime_error("the `verify` action requires --bucket");
+  }
+  if (vm.count("seed") == 0) {
+    throw std::runtime_error("the `verify` action requires --seed");
+  }
+  auto const range =
+      work_range{vm["bucket"].as<std::string>(),
+                 vm["seed"].as<std::uint64_t>(),
+                 0,
+                 vm["object-count"].as<long>(),
+                 (std::max)(1L, vm["task-size"].as<long>()),
+                 vm["use-hash-prefix"].as<bool>(),
+                 std::make_shared<size_distribution const>(
+                     vm["object-size-distribution"].as<std::string>()),
+                 vm["compressible-fraction"].as<double>()};
+  auto const list_concurrency = (std::max)(1, vm["list-concurrency"].as<int>());
+
+  auto client_options =
+      gcs::ClientOptions::CreateDefaultClientOptions().value();
+  client_options.set_connection_pool_size(
+      static_cast<std::size_t>(list_concurrency));
+  auto const client = gcs::Client(std::move(client_options));
+
+  std::vector<std::atomic<std::uint64_t>> found(
+      static_cast<std::size_t>((range.count + 63) / 64));
+  std::atomic<std::int64_t> verified{0};
+  std::atomic<std::int64_t> unexpected{0};
+  std::atomic<std::int64_t> size_mismatch{0};
+  std::atomic<std::int64_t> crc32c_mismatch{0};
+  std::atomic<std::int64_t> skipped{0};
+
+  auto const shards = listing_shards();
+  std::atomic<std::size_t> next_shard{0};
+  auto lister = [&] {
+    cpp_samples::object_name_generator names;
+    work_item wi;
+    std::int64_t current = -1;
+    for (auto s = next_shard++; s < shards.size(); s = next_shard++) {
+      for (auto& o : list_shard(client, range.bucket, shards[s],
+                                "items(name,size,crc32c),nextPageToken")) {
+        if (not o) throw google::cloud::RuntimeStatusError(o.status());
+        std::int64_t offset;
+        std::int64_t index;
+        if (not parse_object_name(o->name(), offset, index)) {
+          ++skipped;
+          continue;
+        }
+        if (offset % range.task_size != 0 or index >= range.task_size or
+            offset + index >= range.count) {
+          ++unexpected;
+          continue;
+        }
+        auto const group = offset / range.task_size;
+        if (group != current) {
+          wi = group_item(range, group);
+          names.reset(wi.prefix, wi.use_hash_prefix);
+          current = group;
+        }
+        // Objects created by other jobs, with a different seed, have other
+        // names.
+        auto const& name = names.name(index);
+        if (name != o->name()) {
+          ++unexpected;
+          continue;
+        }
+        auto const c = make_contents(wi, name, index);
+        auto const i = static_cast<std::size_t>(offset + index);
+        found[i / 64].fetch_or(std::uint64_t{1} << (i % 64));
+        if (static_cast<std::int64_t>(o->size()) != c.size()) {
+          ++size_mismatch;
+        } else if (o->crc32c() != format_crc32c(expected_crc32c(wi, c))) {
+          ++crc32c_mismatch;
+        } else {
+          ++verified;
+        }
+      }
+    }
+  };
+
+  auto report = [&] {
+    std::cout << "Verified " << verified.load() << " objects"
+              << ", size_mismatch=" << size_mismatch.load()
+              << ", crc32c_mismatch=" << crc32c_mismatch.load()
+              << ", unexpected=" << unexpected.load()
+              << ", skipped=" << skipped.load() << std::endl;
+  };
+  std::vector<std::future<void>> listers(
+      static_cast<std::size_t>(list_concurrency));
+  for (auto& t : listers) t = std::async(std::launch::async, lister);
+  wait_with_reports(listers, report);
+  for (auto& t : listers) t.get();
+
+  std::int64_t present = 0;
+  for (auto const& f : found) {
+    present += static_cast<std::int64_t>(
+        std::bitset<64>(f.load()).count());
+  }
+  auto const missing = range.count - present;
+  report();
+  std::cout << "Found " << present << " of " << range.count
+            << " objects, missing=" << missing << std::endl;
+  if (missing != 0 or size_mismatch.load() != 0 or
+      crc32c_mismatch.load() != 0) {
+    throw std::runtime_error("Verification failed");
+  }
+}
+
 }  // namespace